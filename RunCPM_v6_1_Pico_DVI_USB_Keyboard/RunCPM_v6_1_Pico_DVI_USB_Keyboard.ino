@@ -210,6 +210,17 @@ void setup(void) {
   _puthex16(CCPaddr);
   _puts("" TEXT_NORMAL "]\r\n");
 
+#ifdef PROFILE
+  // 0x10xxxxxx runs from XIP flash, 0x20xxxxxx from SRAM (see SRAM_CORE)
+  _puts("Z80 core          at [" TEXT_BOLD "0x");
+  _puthex32((uint32)&Z80run);
+  _puts("" TEXT_NORMAL "]\r\n");
+
+  _puts("Z80 tables        at [" TEXT_BOLD "0x");
+  _puthex32((uint32)parityTable);
+  _puts("" TEXT_NORMAL "]\r\n");
+#endif
+
 #if BANKS > 1
   _puts("Banked Memory        [" TEXT_BOLD "");
   _puthex8(BANKS);
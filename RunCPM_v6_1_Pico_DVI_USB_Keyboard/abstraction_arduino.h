@@ -85,6 +85,469 @@ void _sys_fclose(File32& f) {
 	f.close();
 }
 
+// Pads the file with zeros up to fpos, a sector at a time
+bool _sys_fextend(File32* f, unsigned long fpos)
+{
+	static const uint8 zeros[512] = { 0 };
+	unsigned long size = f->size();
+	unsigned long len;
+
+	if (fpos > size) {
+		if (!f->seek(size))
+			return(false);
+		while (size < fpos) {
+			len = 512 - (size & 511);	// Up to the next sector boundary
+			if (len > fpos - size)
+				len = fpos - size;
+			if (f->write(zeros, len) != len)
+				return(false);
+			size += len;
+		}
+	}
+	return(true);
+}
+
+/*	Open file cache
+
+	Without it, every CP/M record read or written opens the host file (a FAT path walk),
+	seeks, moves 128 bytes and closes the file again. With FILE_CACHE the files used last stay
+	open, keyed by their host path: reads take any handle on the file, writes reopen a read
+	only one for writing, and the least recently used handle is closed to make room. Cached
+	handles are flushed when the program closes the file and before the file is looked at by
+	name (size, directory), and closed when it is deleted, renamed, truncated or made, on
+	warm boot and on disk reset.
+
+	With READAHEAD too, each cached file gets a window of that many bytes: a sequential read
+	that misses it fills it with one large read starting at the 512 byte sector holding the
+	record, and the records after it are then copied from memory. Random reads only use the
+	window, and opening the file for writing empties it.
+
+	With WRITEBACK too, each cached file also gets a write buffer of that many bytes. Records
+	written one after the other are gathered there and go to the card in one write when the
+	buffer reaches a multiple of WRITEBACK in the file (so the next one starts aligned), when
+	a record goes elsewhere, when the file is read, flushed or closed, on BDOS 48 (flush
+	buffers) and once the data has waited WRITEBACK_WAIT ms. If writing it back fails the
+	records stay buffered and are tried again, and the next write to the file, its close or a
+	read of it fails until they make it to the card. Records still buffered when the host closes
+	the file itself (warm boot, delete, rename) are lost, with a message on the console.
+*/
+#ifdef FILE_CACHE
+typedef struct {
+	File32 f;
+	uint8 name[17];			// Host path of the file (see filename)
+	bool write;				// Opened for writing too
+	uint32 used;			// Last use, the lowest is the least recently used
+#ifdef READAHEAD
+	uint32 aheadPos;		// File position of ahead[0]
+	uint32 aheadLen;		// Bytes in ahead[], 0 if empty
+	uint8 ahead[READAHEAD];
+#endif
+#ifdef WRITEBACK
+	uint32 backPos;			// File position of back[0]
+	uint32 backLen;			// Bytes in back[] still to be written, 0 if none
+	uint32 backTime;		// millis() when back[] got its first record, or the last write back failed
+	bool backFailed;		// back[] could not be written to the card
+	uint8 back[WRITEBACK];
+#endif
+} fcache_t;
+
+#if defined(WRITEBACK) && (WRITEBACK & (WRITEBACK - 1))
+#error WRITEBACK must be a power of 2
+#endif
+
+static fcache_t fileCache[FILE_CACHE];
+static fcache_t* fileLast;	// Entry of the last _sys_fileget()
+static uint32 fileUses = 0;
+static uint32 fileHits, fileMisses;	// Shown by PROFILE
+#ifdef READAHEAD
+static uint32 aheadHits, aheadFills;
+#endif
+#ifdef WRITEBACK
+static uint32 backRecords, backSectors;
+
+// Writes the buffered records of an entry to the card, they stay buffered if that fails
+bool _sys_writeback(fcache_t* e) {
+	if (e->backLen) {
+		if (!_sys_fextend(&e->f, e->backPos) || !e->f.seek(e->backPos) ||
+			e->f.write(e->back, e->backLen) != e->backLen) {
+			e->backFailed = TRUE;
+			e->backTime = millis();		// Tried again WRITEBACK_WAIT ms later at the earliest
+			return(FALSE);
+		}
+		backSectors += ((e->backPos + e->backLen + 511) >> 9) - (e->backPos >> 9);
+		e->backLen = 0;
+	}
+	e->backFailed = FALSE;
+	return(TRUE);
+}
+
+// Takes the record at fpos into the write buffer of the file from _sys_fileget(), -1 if what it holds can't be written back
+int _sys_fbuffer(File32* f, uint32 fpos, uint8* buf) {
+	fcache_t* e = fileLast;
+	uint32 end;
+
+	if (e->backFailed && !_sys_writeback(e))
+		return(-1);
+	end = e->backPos + e->backLen;
+	++backRecords;
+	if (e->backLen && fpos >= e->backPos && fpos < end) {	// Written again
+		memcpy(&e->back[fpos - e->backPos], buf, BlkSZ);
+		return(1);
+	}
+	if (e->backLen && (fpos != end || !(end & (WRITEBACK - 1))))
+		if (!_sys_writeback(e))
+			return(-1);
+	if (!e->backLen) {
+		e->backPos = fpos;
+		e->backTime = millis();
+	}
+	memcpy(&e->back[fpos - e->backPos], buf, BlkSZ);
+	e->backLen += BlkSZ;
+	return(1);
+}
+#endif
+
+// Returns an open handle on filename, writable if write is set (NULL if it can't be opened)
+File32* _sys_fileget(uint8* filename, bool write) {
+	fcache_t* e;
+	fcache_t* lru = fileCache;
+
+	for (e = fileCache; e < fileCache + FILE_CACHE; ++e) {
+		if (e->f && !strcmp((char*)e->name, (char*)filename)) {
+			if (write && !e->write) {	// Open again, for writing
+				e->f.close();	// Read only, nothing buffered
+				lru = e;
+				break;
+			}
+			e->used = ++fileUses;
+			++fileHits;
+			fileLast = e;
+#ifdef READAHEAD
+			if (write)
+				e->aheadLen = 0;
+#endif
+#ifdef WRITEBACK
+			if (!write && !_sys_writeback(e))	// The card doesn't have what is to be read
+				return(NULL);
+#endif
+			return(&e->f);
+		}
+		if (lru->f && (!e->f || e->used < lru->used))
+			lru = e;
+	}
+	++fileMisses;
+	if (lru->f) {
+#ifdef WRITEBACK
+		if (!_sys_writeback(lru))	// Its records stay buffered, this open fails instead
+			return(NULL);
+#endif
+		lru->f.close();
+	}
+	lru->f = SD.open((char*)filename, write ? O_RDWR : O_READ);
+	if (!lru->f)
+		return(NULL);
+	strcpy((char*)lru->name, (char*)filename);
+	lru->write = write;
+	lru->used = ++fileUses;
+#ifdef READAHEAD
+	lru->aheadLen = 0;
+#endif
+#ifdef WRITEBACK
+	lru->backLen = 0;
+	lru->backFailed = FALSE;
+#endif
+	fileLast = lru;
+	return(&lru->f);
+}
+
+#define _sys_filedone(f)	// Stays open
+
+// Flushes the handle on filename (all of them if NULL) so the card holds its data and size
+void _sys_cacheflush(uint8* filename) {
+	fcache_t* e;
+
+	for (e = fileCache; e < fileCache + FILE_CACHE; ++e)
+		if (e->f && e->write && (!filename || !strcmp((char*)e->name, (char*)filename))) {
+#ifdef WRITEBACK
+			_sys_writeback(e);
+#endif
+			e->f.flush();
+		}
+}
+
+#ifdef WRITEBACK
+// Tells if records written to filename are still buffered because they could not be written back
+bool _sys_cacheerror(uint8* filename) {
+	fcache_t* e;
+
+	for (e = fileCache; e < fileCache + FILE_CACHE; ++e)
+		if (e->f && e->backFailed && !strcmp((char*)e->name, (char*)filename))
+			return(TRUE);
+	return(FALSE);
+}
+#endif
+
+// Closes the handle on filename (all of them if NULL)
+void _sys_cacheclose(uint8* filename) {
+	fcache_t* e;
+
+	for (e = fileCache; e < fileCache + FILE_CACHE; ++e)
+		if (e->f && (!filename || !strcmp((char*)e->name, (char*)filename))) {
+#ifdef WRITEBACK
+			if (!_sys_writeback(e)) {
+				_puts("\r\nUnable to write back ");
+				_puts((char*)e->name);
+				_puts(", records lost.\r\n");
+			}
+#endif
+			e->f.close();
+		}
+}
+
+#ifdef WRITEBACK
+// Writes back the buffers that waited WRITEBACK_WAIT ms (called on every BDOS call)
+void _sys_cachetick(void) {
+	fcache_t* e;
+
+	for (e = fileCache; e < fileCache + FILE_CACHE; ++e)
+		if (e->f && e->backLen && millis() - e->backTime >= WRITEBACK_WAIT && _sys_writeback(e))
+			e->f.flush();
+}
+#endif
+#else
+static File32 fileOpen;		// The file open during a BDOS call
+
+File32* _sys_fileget(uint8* filename, bool write) {
+	fileOpen = SD.open((char*)filename, write ? O_RDWR : O_READ);
+	return(fileOpen ? &fileOpen : NULL);
+}
+
+#define _sys_filedone(f)	(f)->close()
+#define _sys_cacheflush(filename)
+#define _sys_cacheclose(filename)
+#endif
+
+#if !defined(FILE_CACHE) || !defined(WRITEBACK)
+#define _sys_fbuffer(f, fpos, buf)	0
+#define _sys_cacheerror(filename)	FALSE
+#define _sys_cachetick()
+#endif
+
+/*	Directory index
+
+	Without it, every BDOS search walks the host folder with openNextFile(), reading each
+	entry's name and size from the card, and ERA starts that walk again after each file it
+	deletes. With DIR_CACHE the names and sizes of the files in the last searched drive/user
+	folder are read once into memory. Searches, file sizes and opens in that folder then come
+	from the index, which makes, deletes, renames and writes keep up to date. Folders holding
+	more than DIR_CACHE files are not indexed, until a file in them is deleted. Files the host
+	writes itself (PUN:, LST:, key logs) are kept up to date the same way, snapshots and disk
+	reset drop the index.
+*/
+#ifdef DIR_CACHE
+typedef struct {
+	uint8 name[13];			// Host name
+	uint8 fcb[16];			// Name in CP/M format, as _HostnameToFCBname() gives it
+	uint32 size;
+} dcache_t;
+
+static dcache_t dirCache[DIR_CACHE];
+static dcache_t* dirLast;	// Entry of the last _sys_dirfind()
+static uint8 dirPath[4];	// Folder indexed ("A/0"), [0] is 0 if none
+static bool dirValid;		// dirCache[] holds all the files in dirPath
+static uint16 dirCount;
+static uint16 dirNext;		// Next entry for _findnext()
+static bool dirSearch;		// _findnext() goes through the index
+static uint32 dirHits, dirLoads;
+
+// Drops the index
+void _sys_dirclear(void) {
+	dirPath[0] = 0;
+	dirValid = FALSE;
+	dirLast = NULL;
+}
+
+// Makes the index hold the folder at path, FALSE if it can't
+bool _sys_dirload(uint8* path) {
+	File32 d, f;
+	dcache_t* e;
+
+	dirSearch = FALSE;
+	if (dirPath[0] == path[0] && dirPath[2] == path[2]) {
+		if (dirValid)
+			++dirHits;
+	} else {
+		_sys_dirclear();
+		_sys_cacheflush(NULL);	// The sizes come from the directory
+		if (!(d = SD.open((char*)path)))
+			return(FALSE);
+		++dirLoads;
+		dirValid = TRUE;
+		dirCount = 0;
+		while (f = d.openNextFile()) {
+			if (!f.isDirectory()) {
+				if (dirCount == DIR_CACHE) {
+					dirValid = FALSE;	// Too many files, leave the folder to openNextFile()
+					f.close();
+					break;
+				}
+				e = &dirCache[dirCount++];
+				f.getName((char*)e->name, 13);
+				e->size = f.size();
+				_HostnameToFCBname(e->name, e->fcb);
+			}
+			f.close();
+		}
+		d.close();
+		memcpy(dirPath, path, 4);
+	}
+	dirSearch = dirValid;
+	dirNext = 0;
+	return(dirValid);
+}
+
+// Tells if the index covers the folder of filename
+bool _sys_dirin(uint8* filename) {
+	return(dirValid && dirPath[0] == filename[0] && dirPath[2] == filename[2]);
+}
+
+// Finds filename in the index, NULL if it isn't there (call only when _sys_dirin())
+dcache_t* _sys_dirfind(uint8* filename) {
+	uint8 fcb[16];
+	dcache_t* e;
+
+	_HostnameToFCBname(filename, fcb);
+	if (dirLast && !strcmp((char*)dirLast->fcb, (char*)fcb))
+		return(dirLast);
+	for (e = dirCache; e < dirCache + dirCount; ++e)
+		if (!strcmp((char*)e->fcb, (char*)fcb))
+			return(dirLast = e);
+	return(NULL);
+}
+
+// Adds a file just made to the index
+void _sys_diradd(uint8* filename) {
+	dcache_t* e;
+
+	if (_sys_dirin(filename)) {
+		if (e = _sys_dirfind(filename)) {
+			e->size = 0;
+		} else if (dirCount < DIR_CACHE) {
+			e = &dirCache[dirCount++];
+			strcpy((char*)e->name, (char*)filename + 4);
+			_HostnameToFCBname(e->name, e->fcb);
+			e->size = 0;
+		} else {
+			_sys_dirclear();
+		}
+	}
+}
+
+// Removes a deleted file from the index
+void _sys_dirremove(uint8* filename) {
+	dcache_t* e;
+
+	if (_sys_dirin(filename) && (e = _sys_dirfind(filename))) {
+		if (e - dirCache < dirNext)
+			--dirNext;
+		memmove(e, e + 1, (dirCache + --dirCount - e) * sizeof(dcache_t));
+		dirLast = NULL;
+	} else if (!dirValid && dirPath[0] == filename[0] && dirPath[2] == filename[2]) {
+		_sys_dirclear();	// The folder had too many files, the next search tries it again
+	}
+}
+
+// Renames a file in the index
+void _sys_dirrename(uint8* filename, uint8* newname) {
+	dcache_t* e;
+
+	if (_sys_dirin(filename) && (e = _sys_dirfind(filename))) {
+		strcpy((char*)e->name, (char*)newname + 4);
+		_HostnameToFCBname(e->name, e->fcb);
+	}
+}
+
+// Grows the size of a file in the index to at least size
+void _sys_dirgrow(uint8* filename, uint32 size) {
+	dcache_t* e;
+
+	if (_sys_dirin(filename) && (e = _sys_dirfind(filename)) && e->size < size)
+		e->size = size;
+}
+
+// Puts a file the host writes itself in the index, at size
+void _sys_dirset(uint8* filename, uint32 size) {
+	dcache_t* e;
+
+	if (_sys_dirin(filename)) {
+		if (!(e = _sys_dirfind(filename))) {
+			_sys_diradd(filename);
+			e = _sys_dirfind(filename);		// Still NULL if the index got too big
+		}
+		if (e)
+			e->size = size;
+	}
+}
+#else
+#define _sys_dirclear()
+#define _sys_dirload(path)	FALSE
+#define _sys_diradd(filename)
+#define _sys_dirremove(filename)
+#define _sys_dirrename(filename, newname)
+#define _sys_dirgrow(filename, size)
+#define _sys_dirset(filename, size)
+#endif
+
+// Reads the record at fpos of the file from _sys_fileget() into buf, filling the read-ahead
+// window on a miss if seq is set, returns the bytes read (-1 if fpos is past the end)
+int _sys_fread(File32* f, uint32 fpos, uint8* buf, bool seq) {
+#if defined(FILE_CACHE) && defined(READAHEAD)
+	fcache_t* e = fileLast;
+	uint32 n;
+
+	if (fpos > f->size())
+		return(-1);
+	if (fpos < e->aheadPos || fpos >= e->aheadPos + e->aheadLen) {
+		if (!seq) {
+			f->seek(fpos);
+			return(f->read(buf, BlkSZ));
+		}
+		++aheadFills;
+		e->aheadPos = fpos & ~511;
+		e->aheadLen = 0;
+		if (f->seek(e->aheadPos)) {
+			n = f->read(e->ahead, READAHEAD);
+			e->aheadLen = (int)n > 0 ? n : 0;
+		}
+		if (fpos >= e->aheadPos + e->aheadLen)
+			return(0);
+	} else {
+		++aheadHits;
+	}
+	n = e->aheadPos + e->aheadLen - fpos;
+	if (n > BlkSZ)
+		n = BlkSZ;
+	memcpy(buf, &e->ahead[fpos - e->aheadPos], n);
+	return(n);
+#else
+	if (!f->seek(fpos))
+		return(-1);
+	return(f->read(buf, BlkSZ));
+#endif
+}
+
+// Copies a record read into the DMA buffer
+void _sys_todma(uint8* buf) {
+	uint8 i;
+
+	if (_RamLinear(dmaAddr, BlkSZ)) {
+		memcpy(_RamSysAddr(dmaAddr), buf, BlkSZ);
+	} else {
+		for (i = 0; i < BlkSZ; ++i)
+			_RamWrite(dmaAddr + i, buf[i]);
+	}
+}
+
 int _sys_select(uint8* disk) {
 	uint8 result = FALSE;
 	File32 f;
@@ -102,8 +565,15 @@ int _sys_select(uint8* disk) {
 long _sys_filesize(uint8* filename) {
 	long l = -1;
 	File32 f;
+#ifdef DIR_CACHE
+	dcache_t* e;
+
+	if (_sys_dirin(filename))
+		return((e = _sys_dirfind(filename)) ? e->size : -1);
+#endif
 
 	digitalWrite(LED, HIGH ^ LEDinv);
+	_sys_cacheflush(filename);
 	if (f = SD.open((char*)filename, O_RDONLY)) {
 		l = f.size();
 		f.close();
@@ -116,7 +586,12 @@ int _sys_openfile(uint8* filename) {
 	File32 f;
 	int result = 0;
 
+#ifdef DIR_CACHE
+	if (_sys_dirin(filename))
+		return(_sys_dirfind(filename) != NULL);
+#endif
 	digitalWrite(LED, HIGH ^ LEDinv);
+	_sys_cacheflush(filename);
 	f = SD.open((char*)filename, O_READ);
 	if (f) {
 		f.dirEntry(&fileDirEntry);
@@ -132,9 +607,11 @@ int _sys_makefile(uint8* filename) {
 	int result = 0;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
+	_sys_cacheclose(filename);
 	f = SD.open((char*)filename, O_CREAT | O_WRITE);
 	if (f) {
 		f.close();
+		_sys_diradd(filename);
 		result = 1;
 	}
 	digitalWrite(LED, LOW ^ LEDinv);
@@ -143,7 +620,11 @@ int _sys_makefile(uint8* filename) {
 
 int _sys_deletefile(uint8* filename) {
 	digitalWrite(LED, HIGH ^ LEDinv);
-	return(SD.remove((char*)filename));
+	_sys_cacheclose(filename);
+	if (!SD.remove((char*)filename))
+		return(0);
+	_sys_dirremove(filename);
+	return(1);
 	digitalWrite(LED, LOW ^ LEDinv);
 }
 
@@ -152,10 +633,13 @@ int _sys_renamefile(uint8* filename, uint8* newname) {
 	int result = 0;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
+	_sys_cacheclose(filename);
+	_sys_cacheclose(newname);
 	f = SD.open((char*)filename, O_WRITE | O_APPEND);
 	if (f) {
     if (f.rename((char*)newname)) {
 			f.close();
+			_sys_dirrename(filename, newname);
 			result = 1;
 		}
 	}
@@ -185,18 +669,10 @@ bool _sys_extendfile(char* fn, unsigned long fpos)
 {
 	uint8 result = true;
 	File32 f;
-	unsigned long i;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
 	if (f = SD.open(fn, O_WRITE | O_APPEND)) {
-		if (fpos > f.size()) {
-			for (i = 0; i < f.size() - fpos; ++i) {
-				if (f.write((uint8)0) != 1) {
-					result = false;
-					break;
-				}
-			}
-		}
+		result = _sys_fextend(&f, fpos);
 		f.close();
 	} else {
 		result = false;
@@ -207,27 +683,22 @@ bool _sys_extendfile(char* fn, unsigned long fpos)
 
 uint8 _sys_readseq(uint8* filename, long fpos) {
 	uint8 result = 0xff;
-	File32 f;
-	uint8 bytesread;
+	File32* f;
+	int bytesread;
 	uint8 dmabuf[BlkSZ];
-	uint8 i;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
-	f = SD.open((char*)filename, O_READ);
+	f = _sys_fileget(filename, FALSE);
 	if (f) {
-		if (f.seek(fpos)) {
-			for (i = 0; i < BlkSZ; ++i)
-				dmabuf[i] = 0x1a;
-			bytesread = f.read(&dmabuf[0], BlkSZ);
-			if (bytesread) {
-				for (i = 0; i < BlkSZ; ++i)
-					_RamWrite(dmaAddr + i, dmabuf[i]);
-			}
-			result = bytesread ? 0x00 : 0x01;
+		memset(dmabuf, 0x1a, BlkSZ);
+		bytesread = _sys_fread(f, fpos, dmabuf, TRUE);
+		if (bytesread > 0) {
+			_sys_todma(dmabuf);
+			result = 0x00;
 		} else {
 			result = 0x01;
 		}
-		f.close();
+		_sys_filedone(f);
 	} else {
 		result = 0x10;
 	}
@@ -237,51 +708,53 @@ uint8 _sys_readseq(uint8* filename, long fpos) {
 
 uint8 _sys_writeseq(uint8* filename, long fpos) {
 	uint8 result = 0xff;
-	File32 f;
+	File32* f;
+	int back;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
-	if (_sys_extendfile((char*)filename, fpos))
-		f = SD.open((char*)filename, O_RDWR);
-	if (f) {
-		if (f.seek(fpos)) {
-			if (f.write(_RamSysAddr(dmaAddr), BlkSZ))
+	f = _sys_fileget(filename, TRUE);
+	if (f && (back = _sys_fbuffer(f, fpos, _RamSysAddr(dmaAddr)))) {
+		if (back > 0)
+			result = 0x00;	// Written later (see WRITEBACK)
+	} else if (f && _sys_fextend(f, fpos)) {
+		if (f->seek(fpos)) {
+			if (f->write(_RamSysAddr(dmaAddr), BlkSZ))
 				result = 0x00;
 		} else {
 			result = 0x01;
 		}
-		f.close();
 	} else {
 		result = 0x10;
 	}
+	if (!result)
+		_sys_dirgrow(filename, fpos + BlkSZ);
+	if (f)
+		_sys_filedone(f);
 	digitalWrite(LED, LOW ^ LEDinv);
 	return(result);
 }
 
 uint8 _sys_readrand(uint8* filename, long fpos) {
 	uint8 result = 0xff;
-	File32 f;
-	uint8 bytesread;
+	File32* f;
+	int bytesread;
 	uint8 dmabuf[BlkSZ];
-	uint8 i;
 	long extSize;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
-	f = SD.open((char*)filename, O_READ);
+	f = _sys_fileget(filename, FALSE);
 	if (f) {
-		if (f.seek(fpos)) {
-			for (i = 0; i < BlkSZ; ++i)
-				dmabuf[i] = 0x1a;
-			bytesread = f.read(&dmabuf[0], BlkSZ);
-			if (bytesread) {
-				for (i = 0; i < BlkSZ; ++i)
-					_RamWrite(dmaAddr + i, dmabuf[i]);
-			}
+		memset(dmabuf, 0x1a, BlkSZ);
+		bytesread = _sys_fread(f, fpos, dmabuf, FALSE);
+		if (bytesread >= 0) {
+			if (bytesread)
+				_sys_todma(dmabuf);
 			result = bytesread ? 0x00 : 0x01;
 		} else {
 			if (fpos >= 65536L * BlkSZ) {
 				result = 0x06;	// seek past 8MB (largest file size in CP/M)
 			} else {
-				extSize = f.size();
+				extSize = f->size();
 				// round file size up to next full logical extent
 				extSize = ExtSZ * ((extSize / ExtSZ) + ((extSize % ExtSZ) ? 1 : 0));
 				if (fpos < extSize)
@@ -290,7 +763,7 @@ uint8 _sys_readrand(uint8* filename, long fpos) {
 					result = 0x04; // seek to unwritten extent
 			}
 		}
-		f.close();
+		_sys_filedone(f);
 	} else {
 		result = 0x10;
 	}
@@ -300,23 +773,28 @@ uint8 _sys_readrand(uint8* filename, long fpos) {
 
 uint8 _sys_writerand(uint8* filename, long fpos) {
 	uint8 result = 0xff;
-	File32 f;
+	File32* f;
+	int back;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
-	if (_sys_extendfile((char*)filename, fpos)) {
-		f = SD.open((char*)filename, O_RDWR);
-	}
-	if (f) {
-		if (f.seek(fpos)) {
-			if (f.write(_RamSysAddr(dmaAddr), BlkSZ))
+	f = _sys_fileget(filename, TRUE);
+	if (f && (back = _sys_fbuffer(f, fpos, _RamSysAddr(dmaAddr)))) {
+		if (back > 0)
+			result = 0x00;	// Written later (see WRITEBACK)
+	} else if (f && _sys_fextend(f, fpos)) {
+		if (f->seek(fpos)) {
+			if (f->write(_RamSysAddr(dmaAddr), BlkSZ))
 				result = 0x00;
 		} else {
 			result = 0x06;
 		}
-		f.close();
 	} else {
 		result = 0x10;
 	}
+	if (!result)
+		_sys_dirgrow(filename, fpos + BlkSZ);
+	if (f)
+		_sys_filedone(f);
 	digitalWrite(LED, LOW ^ LEDinv);
 	return(result);
 }
@@ -327,6 +805,30 @@ static uint16 fileExtents = 0;
 static uint16 fileExtentsUsed = 0;
 static uint16 firstFreeAllocBlock;
 
+// Sets up the search results for the file found in findNextDirName
+uint8 _findfound(uint8 isdir, uint32 bytes) {
+	if (isdir) {
+		// account for host files that aren't multiples of the block size
+		// by rounding their bytes up to the next multiple of blocks
+		if (bytes & (BlkSZ - 1)) {
+			bytes = (bytes & ~(BlkSZ - 1)) + BlkSZ;
+		}
+		fileRecords = bytes / BlkSZ;
+		fileExtents = fileRecords / BlkEX + ((fileRecords & (BlkEX - 1)) ? 1 : 0);
+		fileExtentsUsed = 0;
+		firstFreeAllocBlock = firstBlockAfterDir;
+		_mockupDirEntry();
+	} else {
+		fileRecords = 0;
+		fileExtents = 0;
+		fileExtentsUsed = 0;
+		firstFreeAllocBlock = firstBlockAfterDir;
+	}
+	_RamWrite(tmpFCB, filename[0] - '@');
+	_HostnameToFCB(tmpFCB, findNextDirName);
+	return(0x00);
+}
+
 uint8 _findnext(uint8 isdir) {
 	File32 f;
 	uint8 result = 0xff;
@@ -337,6 +839,17 @@ uint8 _findnext(uint8 isdir) {
 	if (allExtents && fileRecords) {
 		_mockupDirEntry();
 		result = 0;
+#ifdef DIR_CACHE
+	} else if (dirSearch) {
+		while (dirNext < dirCount) {
+			if (match(dirCache[dirNext].fcb, pattern)) {
+				strcpy((char*)findNextDirName, (char*)dirCache[dirNext].name);
+				result = _findfound(isdir, dirCache[dirNext++].size);
+				break;
+			}
+			++dirNext;
+		}
+#endif
 	} else {
 		while (f = userdir.openNextFile()) {
 			f.getName((char*)&findNextDirName[0], 13);
@@ -348,26 +861,7 @@ uint8 _findnext(uint8 isdir) {
 				continue;
 			_HostnameToFCBname(findNextDirName, fcbname);
 			if (match(fcbname, pattern)) {
-				if (isdir) {
-					// account for host files that aren't multiples of the block size
-					// by rounding their bytes up to the next multiple of blocks
-					if (bytes & (BlkSZ - 1)) {
-						bytes = (bytes & ~(BlkSZ - 1)) + BlkSZ;
-					}
-					fileRecords = bytes / BlkSZ;
-					fileExtents = fileRecords / BlkEX + ((fileRecords & (BlkEX - 1)) ? 1 : 0);
-					fileExtentsUsed = 0;
-					firstFreeAllocBlock = firstBlockAfterDir;
-					_mockupDirEntry();
-				} else {
-					fileRecords = 0;
-					fileExtents = 0;
-					fileExtentsUsed = 0;
-					firstFreeAllocBlock = firstBlockAfterDir;
-				}
-				_RamWrite(tmpFCB, filename[0] - '@');
-				_HostnameToFCB(tmpFCB, findNextDirName);
-				result = 0x00;
+				result = _findfound(isdir, bytes);
 				break;
 			}
 		}
@@ -382,7 +876,10 @@ uint8 _findfirst(uint8 isdir) {
 	path[2] = filename[2];
 	if (userdir)
 		userdir.close();
-	userdir = SD.open((char*)path); // Set directory search to start from the first position
+	if (!_sys_dirload(path)) {	// Not from the index (see DIR_CACHE)
+		_sys_cacheflush(NULL);	// The sizes listed come from the directory
+		userdir = SD.open((char*)path); // Set directory search to start from the first position
+	}
 	_HostnameToFCBname(filename, pattern);
 	fileRecords = 0;
 	fileExtents = 0;
@@ -432,6 +929,10 @@ uint8 _findfirstallusers(uint8 isdir) {
 		rootdir.close();
 	if (userdir)
 		userdir.close();
+	_sys_cacheflush(NULL);
+#ifdef DIR_CACHE
+	dirSearch = FALSE;
+#endif
 	rootdir = SD.open((char*)path); // Set directory search to start from the first position
 	strcpy((char*)pattern, "???????????");
 	if (!rootdir)
@@ -447,10 +948,12 @@ uint8 _Truncate(char* filename, uint8 rc) {
 	int result = 0;
 
 	digitalWrite(LED, HIGH ^ LEDinv);
+	_sys_cacheclose((uint8*)filename);
 	f = SD.open((char*)filename, O_WRITE | O_APPEND);
 	if (f) {
 		if (f.truncate(rc * BlkSZ)) {
 			f.close();
+			_sys_dirset((uint8*)filename, rc * BlkSZ);
 			result = 1;
 		}
 	}
@@ -469,6 +972,65 @@ void _MakeUserDir() {
 	digitalWrite(LED, LOW ^ LEDinv);
 }
 
+#ifdef SNAPSHOT
+bool _sys_writefile(uint8* filename, uint8* hdr, uint32 hlen, uint8* data, uint32 dlen) {	// Creates filename with hdr followed by data
+	File32 f;
+	bool result = false;
+
+	digitalWrite(LED, HIGH ^ LEDinv);
+	_sys_dirclear();
+	if (f = SD.open((char*)filename, O_CREAT | O_WRITE | O_TRUNC)) {
+		result = f.write(hdr, hlen) == hlen && f.write(data, dlen) == dlen;
+		f.close();
+	}
+	digitalWrite(LED, LOW ^ LEDinv);
+	return(result);
+}
+
+bool _sys_readfile(uint8* filename, uint32 offset, uint8* data, uint32 len) {	// Reads len bytes from offset onwards
+	File32 f;
+	bool result = false;
+
+	digitalWrite(LED, HIGH ^ LEDinv);
+	if (f = SD.open((char*)filename, O_READ)) {
+		if (f.seek(offset))
+			result = f.read(data, len) == (int)len;
+		f.close();
+	}
+	digitalWrite(LED, LOW ^ LEDinv);
+	return(result);
+}
+#endif
+
+#ifdef KEYLOG
+File32 keylogFile;
+static uint8 keylogName[17];
+
+bool _sys_keylog_open(uint8* filename, bool write) {
+	keylogFile = SD.open((char*)filename, write ? O_CREAT | O_WRITE | O_TRUNC : O_READ);
+	if (keylogFile && write) {
+		strcpy((char*)keylogName, (char*)filename);
+		_sys_dirset(keylogName, 0);
+	}
+	return(keylogFile);
+}
+
+bool _sys_keylog_write(uint8* data, uint32 len) {
+	bool result = keylogFile.write(data, len) == len;
+
+	_sys_dirset(keylogName, keylogFile.size());
+	return(result);
+}
+
+bool _sys_keylog_read(uint8* data, uint32 len) {
+	return(keylogFile.read(data, len) == (int)len);
+}
+
+void _sys_keylog_close(void) {
+	keylogFile.close();
+}
+#endif
+
 uint8 _sys_makedisk(uint8 drive) {
 	uint8 result = 0;
 	if (drive < 1 || drive>16) {
@@ -509,10 +1071,28 @@ int _kbhit(void) {
     return(Serial1.available());
 }
 
+#if defined(IDLE_POLLS) || defined(HALT_WAIT)
+int _idlewait(uint32 ms) {
+    uint32 start = millis();
+    while(!_kbhit()) {
+        if(millis() - start >= ms) { return false; }
+#ifdef ARDUINO_ARCH_RP2040
+        __wfe();    // Woken by the next interrupt, at the latest by the 100us USB host timer
+#else
+        yield();
+#endif
+    }
+    return true;
+}
+#endif
+
 uint8 _getch(void) {
     while(true) {
         if(_kbhit_hook && _kbhit_hook()) { return _getch_hook(); }
         if(Serial1.available()) { return Serial1.read(); }
+#ifdef IDLE_POLLS
+        _idlewait(IDLE_WAIT);
+#endif
     }
 }
 
@@ -531,9 +1111,14 @@ void _clrscr(void) {
 	Serial1.print("\e[H\e[J");
 
 #if USE_DISPLAY
+#ifdef CONSOLE_RING
+    for (const char* s = "\e[H\e[J"; *s; s++)  // The framebuffer belongs to the service task
+        _putch_hook(*s);
+#else
     display.fillScreen(0);
     display.setCursor(0, 0);
 #endif
+#endif
 
 }
 
@@ -47,6 +47,14 @@ static const char *Commands[] =
     "PAGE",
     "VOL",
     "?",
+#ifdef SNAPSHOT
+    "SNAP",
+    "RESUME",
+#endif
+#ifdef KEYLOG
+    "RECORD",
+    "REPLAY",
+#endif
     NULL
 };
 
@@ -59,6 +67,18 @@ uint16 _ccp_bdos(uint8 function, uint16 de) {
     return (HL & 0xffff);
 } // _ccp_bdos
 
+// Runs a program from the current Z80 registers, used for both external commands and RESUME
+void _ccp_run(void) {
+#ifdef SNAPSHOT
+    snapArmed = snapNext;                       // A pending SNAP applies to this program
+    snapNext = FALSE;
+#endif
+    Z80run();
+#ifdef SNAPSHOT
+    snapArmed = FALSE;
+#endif
+} // _ccp_run
+
 // Compares two strings (Atmel doesn't like strcmp)
 uint8 _ccp_strcmp(char *stra, char *strb) {
     while (*stra && *strb && (*stra == *strb)) {
@@ -405,6 +425,64 @@ uint8 _ccp_vol(void) {
     return (error);
 } // _ccp_vol
 
+#ifdef SNAPSHOT
+// SNAP command
+uint8 _ccp_snap(void) {
+    uint8 error = TRUE;
+
+    if (_RamRead(ParFCB + 1) != ' ' && _FCBtoHostname(ParFCB, &snapName[0]) && !_SelectDisk(_RamRead(ParFCB))) {
+        snapNext = TRUE;                                // Taken when the next program first waits for the console
+        error = FALSE;
+    }
+    return (error);
+} // _ccp_snap
+
+// RESUME command
+uint8 _ccp_resume(void) {
+    uint8 error = TRUE;
+
+    if (_RamRead(ParFCB + 1) != ' ' && _FCBtoHostname(ParFCB, &filename[0]) && !_SelectDisk(_RamRead(ParFCB))) {
+        if (!_LoadSnapshot(&filename[0])) {
+            _puts("\r\n");
+            _ccp_run();                                 // Continues where the snapshot was taken
+            _ccp_bdos(F_USERNUM, curUser);              // The snapshot brought its own user, set the CCP's back
+            _ccp_bdos(F_DMAOFF, defDMA);                // And its DMA
+            error = FALSE;
+        }
+    }
+    return (error);
+} // _ccp_resume
+#endif
+
+#ifdef KEYLOG
+#ifdef SNAPSHOT
+#define CCP_RECORD 14
+#else
+#define CCP_RECORD 12
+#endif
+
+// RECORD/REPLAY commands
+uint8 _ccp_keylog(uint8 mode) {
+    uint8 error = TRUE;
+
+    if (_RamRead(ParFCB + 1) == ' ') {                  // No file, stops and shows what was done
+        _keylogStop();
+        _puts("\r\n");
+        _putdec64(keyCount);
+        _puts(" bytes");
+        if (keyDrift) {
+            _puts(", ");
+            _putdec64(keyDrift);
+            _puts(" out of step");
+        }
+        error = FALSE;
+    } else if (_FCBtoHostname(ParFCB, &filename[0]) && !_SelectDisk(_RamRead(ParFCB))) {
+        error = !_keylogStart(&filename[0], mode);
+    }
+    return (error);
+} // _ccp_keylog
+#endif
+
 // ?/Help command
 uint8 _ccp_hlp(void) {
     _puts("\r\nCCP Commands:\r\n");
@@ -416,6 +494,16 @@ uint8 _ccp_hlp(void) {
     _puts("\t    or disables paging if no parameter passed\r\n");
     _puts("\tVOL [drive] - Shows the volume information\r\n");
     _puts("\t    which comes from each volume's INFO.TXT");
+#ifdef SNAPSHOT
+    _puts("\r\n\tSNAP <file> - Saves a snapshot of the next program\r\n");
+    _puts("\t    as soon as it waits for the console\r\n");
+    _puts("\tRESUME <file> - Continues from a snapshot");
+#endif
+#ifdef KEYLOG
+    _puts("\r\n\tRECORD [<file>] - Records the console input to file\r\n");
+    _puts("\t    or stops and shows the count if no file passed\r\n");
+    _puts("\tREPLAY [<file>] - Replays the console input from file");
+#endif
     return(FALSE);
 }
 #ifdef HASLUA
@@ -628,7 +716,7 @@ uint8 _ccp_ext(void) {
         PC = loadAddr;									// Sets CP/M application jump point
         SP = BDOSjmppage;								// Sets the stack to the top of the TPA
         
-        Z80run();										// Starts Z80 simulation
+        _ccp_run();										// Starts Z80 simulation
         
         error = FALSE;
     }
@@ -842,6 +930,9 @@ void _ccp(void) {
                 }
                     
                 case 8: {           // EXIT
+#ifdef KEYLOG
+                    _keylogStop();
+#endif
                     _puts(	"Terminating RunCPM.\r\n");
                     _puts(	"CPU Halted.\r\n");
                     Status = 1;
@@ -862,6 +953,30 @@ void _ccp(void) {
                     i = _ccp_hlp();
                     break;
                 }
+
+#ifdef SNAPSHOT
+                case 12: {          // SNAP
+                    i = _ccp_snap();
+                    break;
+                }
+
+                case 13: {          // RESUME
+                    i = _ccp_resume();
+                    break;
+                }
+#endif
+
+#ifdef KEYLOG
+                case CCP_RECORD: {  // RECORD
+                    i = _ccp_keylog(KEYLOG_RECORD);
+                    break;
+                }
+
+                case CCP_RECORD + 1: {  // REPLAY
+                    i = _ccp_keylog(KEYLOG_REPLAY);
+                    break;
+                }
+#endif
                     
                 // External/Lua commands
                 case 255: {         // It is an external command
@@ -18,18 +18,187 @@ uint8 mask8bit = 0x7f;		// TO be used for masking 8 bit characters (XMODEM relat
 							// required for XMODEM to work.
 							// Use the CONSOLE7 and CONSOLE8 programs to change this on the fly.
 
+#if defined(IDLE_POLLS) || defined(HALT_WAIT)
+int _idlewait(uint32 ms);	// Sleeps until there's input or ms have passed, returns _kbhit() (see the abstraction)
+#endif
+
+#ifdef IDLE_POLLS
+uint32 idlePolls = 0;		// Polls in a row that found no input, each within IDLE_GAP M1 cycles of the last
+uint32 pollsEmpty = 0;		// Console polls that found no input
+uint32 pollsSlept = 0;		// Of these, the ones coalesced into a sleep of up to IDLE_WAIT ms
+#ifdef DO_INCR
+extern uint32 M1count;		// see cpu.h
+static uint32 pollEnd = 0;	// M1count when the last poll returned to the guest
+#endif
+
+int _kbidle(void)			// Checks for input, sleeping when a program does nothing but poll
+{
+	int result = 0;
+
+#ifdef DO_INCR
+	if (M1count - pollEnd >= IDLE_GAP)	// The program worked since the last poll
+		idlePolls = 0;
+#endif
+	if (_kbhit()) {
+		idlePolls = 0;
+		result = 1;
+	} else {
+		pollsEmpty++;
+		if (++idlePolls >= IDLE_POLLS) {
+			pollsSlept++;
+			if (_idlewait(IDLE_WAIT)) {
+				idlePolls = 0;
+				result = 1;
+			}
+		}
+	}
+#ifdef DO_INCR
+	pollEnd = M1count;
+#endif
+	return(result);
+}
+#else
+#define _kbidle _kbhit
+#endif
+
+#ifdef KEYLOG
+/* Console input record/replay
+   While recording, every byte the guest reads is logged with the number of console polls
+   since recording started at the point the guest first saw it, and with DO_CYCLES the T-states
+   at the point it took it. Replaying ignores the live input and hands the same bytes over at
+   the same poll counts, so an interactive session reruns exactly as it was recorded.
+*/
+bool _sys_keylog_open(uint8* filename, bool write);	// see the abstraction
+bool _sys_keylog_write(uint8* data, uint32 len);
+bool _sys_keylog_read(uint8* data, uint32 len);
+void _sys_keylog_close(void);
+
+#ifdef DO_CYCLES
+extern uint64 Cycles;		// see cpu.h
+#define KEYLOG_CYCLES (Cycles - keyBase)
+#else
+#define KEYLOG_CYCLES 0
+#endif
+
+#define KEYLOG_OFF 0
+#define KEYLOG_RECORD 1
+#define KEYLOG_REPLAY 2
+
+typedef struct {
+	uint32 poll;			// Console polls since the start when the guest first saw the byte
+	uint8 ch;				// The byte
+	uint8 filler[3];
+	uint64 cycles;			// T-states since the start when the guest took it (0 without DO_CYCLES)
+} keyrec_t;
+
+uint8 keyMode = KEYLOG_OFF;
+uint8 keyPending = FALSE;	// Recording: keyRec.poll holds the stamp of a byte seen but not taken yet
+keyrec_t keyRec;			// Recording: the byte being stamped, replaying: the next byte to hand over
+uint32 keyPolls = 0;		// Console polls since the start
+uint32 keyCount = 0;		// Bytes recorded or replayed
+uint32 keyDrift = 0;		// Bytes replayed at a different poll count or T-state than recorded
+uint64 keyBase = 0;			// Cycles at the start
+
+void _keylogStop(void)
+{
+	if (keyMode != KEYLOG_OFF) {
+		_sys_keylog_close();
+		keyMode = KEYLOG_OFF;
+	}
+}
+
+void _keylogNext(void)		// Loads the next byte to replay, going back to live input at the end of the log
+{
+	if (!_sys_keylog_read((uint8*)&keyRec, sizeof(keyRec)))
+		_keylogStop();
+}
+
+bool _keylogStart(uint8* filename, uint8 mode)
+{
+	_keylogStop();
+	if (!_sys_keylog_open(filename, mode == KEYLOG_RECORD))
+		return(false);
+	keyMode = mode;
+	keyPending = FALSE;
+	keyPolls = 0;
+	keyCount = 0;
+	keyDrift = 0;
+#ifdef DO_CYCLES
+	keyBase = Cycles;
+#endif
+	if (mode == KEYLOG_REPLAY)
+		_keylogNext();
+	return(true);
+}
+
+int _keyhit(void)			// Checks for input on behalf of the guest
+{
+	keyPolls++;
+	if (keyMode == KEYLOG_REPLAY)
+		return(keyPolls >= keyRec.poll);
+	if (!_kbidle())
+		return(0);
+	if (keyMode == KEYLOG_RECORD && !keyPending) {
+		keyRec.poll = keyPolls;
+		keyPending = TRUE;
+	}
+	return(1);
+}
+
+uint8 _getcon(void)			// Gets a character on behalf of the guest, blocking, no echo
+{
+	uint8 ch;
+
+	keyPolls++;
+	if (keyMode == KEYLOG_REPLAY) {
+		ch = keyRec.ch;
+		if (keyPolls < keyRec.poll || keyRec.cycles != KEYLOG_CYCLES)
+			keyDrift++;
+		keyCount++;
+		_keylogNext();
+		return(ch);
+	}
+	ch = _getch();
+	if (keyMode == KEYLOG_RECORD) {
+		if (!keyPending)
+			keyRec.poll = keyPolls;
+		keyRec.ch = ch;
+		keyRec.cycles = KEYLOG_CYCLES;
+		keyPending = FALSE;
+		keyCount++;
+		if (!_sys_keylog_write((uint8*)&keyRec, sizeof(keyRec)))
+			_keylogStop();
+	}
+	return(ch);
+}
+
+uint8 _getcone(void)		// Same with echo
+{
+	uint8 ch = _getcon();
+	_putch(ch);
+	return(ch);
+}
+#else
+#define _keyhit _kbidle
+#define _getcon _getch
+#define _getcone _getche
+#endif
+
 uint8 _chready(void)		// Checks if there's a character ready for input
 {
-	return(_kbhit() ? 0xff : 0x00);
+	return(_keyhit() ? 0xff : 0x00);
 }
 
 uint8 _getchNB(void)		// Gets a character, non-blocking, no echo
 {
-	return(_kbhit() ? _getch() : 0x00);
+	return(_keyhit() ? _getcon() : 0x00);
 }
 
 void _putcon(uint8 ch)		// Puts a character
 {
+#ifdef IDLE_POLLS
+	idlePolls = 0;			// A program that polls while printing is not idle
+#endif
 	_putch(ch & mask8bit);
 }
 
@@ -51,6 +220,12 @@ void _puthex16(uint16 w)	// puts a HHHH hex string
 	_puthex8(w & 0x00ff);
 }
 
+void _puthex32(uint32 w)	// puts a HHHHHHHH hex string
+{
+	_puthex16(w >> 16);
+	_puthex16(w & 0xffff);
+}
+
 void _putdec(uint16_t w) {
     char buf[] = "    0";
     size_t i=sizeof(buf)-1;
@@ -61,4 +236,16 @@ void _putdec(uint16_t w) {
     }
     _puts(buf);
 }
+
+void _putdec64(uint64 w)	// puts an unpadded decimal string
+{
+	char buf[21];
+	size_t i = sizeof(buf) - 1;
+	buf[i] = 0;
+	do {
+		buf[--i] = '0' + (w % 10);
+		w /= 10;
+	} while (w);
+	_puts(&buf[i]);
+}
 #endif
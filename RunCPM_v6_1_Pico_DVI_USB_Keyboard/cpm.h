@@ -123,6 +123,9 @@ enum eBDOSFunc {
 	F_AWRITE = 224,
 	F_SETMASK = 230,
 	F_BDOSCALL = 231,
+	F_SNAPSAVE = 245,
+	F_SNAPLOAD = 246,
+	F_CYCLES = 247,
 	F_UPTIME = 248,
 	F_MAKEDISK = 249,
 	F_HOSTOS = 250,
@@ -152,6 +155,10 @@ char lst_file[17] = {'A', FOLDERCHAR, '0', FOLDERCHAR, 'L', 'S', 'T', '.', 'T',
 #ifdef PROFILE
 unsigned long time_start = 0;
 unsigned long time_now = 0;
+uint64 instrs_start = 0;
+#ifdef DO_CYCLES
+uint64 cycles_start = 0;
+#endif
 #endif // ifdef PROFILE
 
 void _PatchCPM(void) {
@@ -526,12 +533,19 @@ void _Bios(void) {
 	_logBiosIn(ch);
 #endif
 
+#ifdef SNAPSHOT
+	if (snapArmed && (ch == B_CONST || ch == B_CONIN))
+		_SnapshotArmed();
+#endif
+
 	switch (ch) {
 		case B_BOOT: {
+			_sys_cacheclose(NULL);
 			Status = 1;		// 0 - Ends RunCPM
 			break;
 		}
 		case B_WBOOT: {
+			_sys_cacheclose(NULL);
 			Status = 2;		// 1 - Back to CCP
 			break;
 		}
@@ -540,7 +554,7 @@ void _Bios(void) {
 			break;
 		}
 		case B_CONIN: {		// 3 - Console input
-			SET_HIGH_REGISTER(AF, _getch());
+			SET_HIGH_REGISTER(AF, _getcon());
 #ifdef DEBUG
 			if (HIGH_REGISTER(AF) == 4)
 				Debug = 1;
@@ -631,8 +645,10 @@ void _Bios(void) {
 		case B_MOVE: {		// 25 - Move a block of memory
 			if (!isXmove)
 				srcBank = dstBank = curBank;
-			while (BC--)
-				RAM[HL++ * dstBank] = RAM[DE++ * srcBank];
+			_RamMove(dstBank, HL, srcBank, DE, BC);
+			HL = (HL + BC) & 0xffff;	// Both end up past the block, as with LDIR
+			DE = (DE + BC) & 0xffff;
+			BC = 0;
 			isXmove = FALSE;
 			break;
 		}
@@ -640,7 +656,7 @@ void _Bios(void) {
 			break;
 		}
 		case B_SELMEM: {	// 27 - Select memory bank
-			curBank = HIGH_REGISTER(AF);
+			_RamSelect(HIGH_REGISTER(AF));
 			break;
 		}
 		case B_SETBNK: {	// 28 - Set the bank to be used for the next read/write sector operation
@@ -653,6 +669,7 @@ void _Bios(void) {
 			break;
 		}
 		case B_USERF: {		// 30 - This allows programs ending in RET return to internal CCP
+			_sys_cacheclose(NULL);
 			Status = 3;
 			break;
 		}
@@ -682,6 +699,12 @@ void _Bdos(void) {
 #ifdef DEBUGLOG
 	_logBdosIn(ch);
 #endif
+	_sys_cachetick();
+
+#ifdef SNAPSHOT
+	if (snapArmed && (ch == C_READ || (ch == C_RAWIO && LOW_REGISTER(DE) == 0xff) || ch == C_READSTR || ch == C_STAT))
+		_SnapshotArmed();
+#endif
 
 	HL = 0x0000;                            // HL is reset by the BDOS
 	SET_LOW_REGISTER(BC, LOW_REGISTER(DE)); // C ends up equal to E
@@ -692,6 +715,7 @@ void _Bdos(void) {
 		   Doesn't return. Reloads CP/M
 		 */
 		case P_TERMCPM: {
+			_sys_cacheclose(NULL);
 			Status = 2; // Same as call to "BOOT"
 			break;
 		}
@@ -702,7 +726,7 @@ void _Bdos(void) {
 		   Returns: A=Char
 		 */
 		case C_READ: {
-			HL = _getche();
+			HL = _getcone();
 #ifdef DEBUG
 			if (HL == 4)
 				Debug = 1;
@@ -740,6 +764,7 @@ void _Bdos(void) {
 			}
 			if (pun_dev) {
 				_sys_fputc(LOW_REGISTER(DE), pun_dev);
+				_sys_dirset((uint8 *)pun_file, pun_dev.size());	// PUN.TXT grows behind BDOS (see DIR_CACHE)
 			}
 #endif // ifdef USE_PUN
 			break;
@@ -754,8 +779,10 @@ void _Bdos(void) {
 				lst_dev = _sys_fopen_w((uint8 *)lst_file);
 				lst_open = TRUE;
 			}
-			if (lst_dev)
+			if (lst_dev) {
 				_sys_fputc(LOW_REGISTER(DE), lst_dev);
+				_sys_dirset((uint8 *)lst_file, lst_dev.size());	// LST.TXT grows behind BDOS (see DIR_CACHE)
+			}
 #endif // ifdef USE_LST
 			break;
 		}
@@ -846,7 +873,56 @@ void _Bdos(void) {
 			if (time_start != 0) {
 				time_now = millis();
 				printf(" (%ld)\n", time_now - time_start);
+				uint64 ms = time_now > time_start ? time_now - time_start : 1;
+				_puts("Instructions: ");
+				_putdec64(Instrs - instrs_start); _puts(" (");
+				_putdec64((Instrs - instrs_start) * 1000 / ms); _puts("/s)\r\n");
+#ifdef DO_CYCLES
+				_puts("T-states: ");
+				_putdec64(Cycles - cycles_start); _puts(" (");
+				_putdec64((Cycles - cycles_start) * 1000 / ms); _puts("/s)\r\n");
+#endif
 				time_start = 0;
+#ifdef Z80_BLOCKS
+				_puts("Blocks hit/miss/invalidated/flushed: ");
+				_putdec64(blockHits); _putcon('/');
+				_putdec64(blockMisses); _putcon('/');
+				_putdec64(blockInvalidations); _putcon('/');
+				_putdec64(blockFlushes); _puts("\r\n");
+#endif
+#ifdef PAIRS
+				Z80pairsShow();
+#endif
+#ifdef IDLE_POLLS
+				_puts("Console polls empty/slept: ");
+				_putdec64(pollsEmpty); _putcon('/');
+				_putdec64(pollsSlept); _puts("\r\n");
+#endif
+#ifdef FILE_CACHE
+				_puts("Open file cache hits/misses: ");
+				_putdec64(fileHits); _putcon('/');
+				_putdec64(fileMisses); _puts("\r\n");
+#ifdef READAHEAD
+				_puts("Read-ahead hits/fills: ");
+				_putdec64(aheadHits); _putcon('/');
+				_putdec64(aheadFills); _puts("\r\n");
+#endif
+#ifdef WRITEBACK
+				_puts("Records/sectors written: ");
+				_putdec64(backRecords); _putcon('/');
+				_putdec64(backSectors); _puts("\r\n");
+#endif
+#endif
+#ifdef DIR_CACHE
+				_puts("Directory index hits/loads: ");
+				_putdec64(dirHits); _putcon('/');
+				_putdec64(dirLoads); _puts("\r\n");
+#endif
+#ifdef HALT_WAIT
+				_puts("HALTs slept/T-states skipped: ");
+				_putdec64(haltCount); _putcon('/');
+				_putdec64(haltCycles); _puts("\r\n");
+#endif
 			}
 #endif // ifdef PROFILE
             uint8 chrsMax = _RamRead(chrsMaxIdx);   // Gets the max number of characters that can be read
@@ -857,7 +933,7 @@ void _Bdos(void) {
                 // pre-backspace, retype & post backspace counts
                 uint8 preBS = 0, reType = 0, postBS = 0;
 
-                chr = _getch(); //input a character
+                chr = _getcon(); //input a character
 
                 if (chr == 1) {                             // ^A - Move cursor one character to the left
                     if (curCol > 0) {
@@ -939,6 +1015,32 @@ void _Bdos(void) {
                 if ((chr == 0x0A) || (chr == 0x0D)) {   // ^J and ^M - Ends editing
 #ifdef PROFILE
                     time_start = millis();
+                    instrs_start = Instrs;
+#ifdef DO_CYCLES
+                    cycles_start = Cycles;
+#endif
+#ifdef Z80_BLOCKS
+                    blockHits = blockMisses = blockInvalidations = blockFlushes = 0;
+#endif
+#ifdef IDLE_POLLS
+                    pollsEmpty = pollsSlept = 0;
+#endif
+#ifdef FILE_CACHE
+                    fileHits = fileMisses = 0;
+#ifdef READAHEAD
+                    aheadHits = aheadFills = 0;
+#endif
+#ifdef WRITEBACK
+                    backRecords = backSectors = 0;
+#endif
+#endif
+#ifdef DIR_CACHE
+                    dirHits = dirLoads = 0;
+#endif
+#ifdef HALT_WAIT
+                    haltCount = 0;
+                    haltCycles = 0;
+#endif
 #endif
                     break;
                 }
@@ -1087,6 +1189,8 @@ void _Bdos(void) {
 		   C = 13 (0Dh) : Reset disk system
 		 */
 		case DRV_ALLRESET: {
+			_sys_cacheclose(NULL);
+			_sys_dirclear();
 			roVector = 0;       // Make all drives R/W
 			loginVector = 0;
 			dmaAddr = 0x0080;
@@ -1428,6 +1532,7 @@ void _Bdos(void) {
 		   	    H = Physical Error
 		 */
 		case DRV_FLUSH: {
+			_sys_cacheflush(NULL);
 			break;
 		}
 
@@ -1719,6 +1824,58 @@ void _Bdos(void) {
 
 #endif // if defined board_stm32
 
+#ifdef SNAPSHOT
+		/*
+		   C = 245 (F5h) : Save snapshot
+		   DE = FCB naming the snapshot file
+		   Returns: A = 0x00 on success, 0xFF on error
+		   When the snapshot is resumed this call returns again, with A = 0x01
+		 */
+		case F_SNAPSAVE: {
+			int32 oAF = AF, oBC = BC;
+			HL = 0x0001;					// What the resumed program sees
+			SET_HIGH_REGISTER(BC, 0x00);
+			SET_HIGH_REGISTER(AF, 0x01);
+			if (_FCBtoHostname(DE, &filename[0]) && !_SelectDisk(_RamRead(DE)))
+				HL = _SaveSnapshot(&filename[0], PC);
+			else
+				HL = 0xff;
+			AF = oAF;
+			BC = oBC;
+			break;
+		}
+
+		/*
+		   C = 246 (F6h) : Load snapshot
+		   DE = FCB naming the snapshot file
+		   Returns: A = 0xFF on error, otherwise continues the snapshot
+		 */
+		case F_SNAPLOAD: {
+			if (_FCBtoHostname(DE, &filename[0]) && !_SelectDisk(_RamRead(DE)) && !_LoadSnapshot(&filename[0]))
+				return;							// All registers come from the snapshot, nothing else to return
+			HL = 0xff;
+			break;
+		}
+
+#endif // ifdef SNAPSHOT
+#ifdef DO_CYCLES
+		/*
+		   C = 247 (F7h) : T-states Counter
+		   Copies the 64 bit count of T-states executed (since the board started)
+		   to the 8 bytes pointed to by DE, least significant byte first.
+		 */
+		case F_CYCLES:
+		{
+			uint64 cycles = Cycles;
+			for (i = 0; i < 8; ++i) {
+				_RamWrite(DE + i, cycles & 0xFF);
+				cycles >>= 8;
+			}
+			HL = 0;
+			break;
+		}
+
+#endif // ifdef DO_CYCLES
 		/*
 		   C = 248 (F8h) : Milliseconds Uptime
 		   Returns the number of milliseconds (since the board started).
@@ -24,20 +24,246 @@ int32 IFF; /* Interrupt Flip Flop                          */
 int32 IR;  /* Interrupt (upper) / Refresh (lower) register */
 int32 Status = 0; /* Status of the CPU 0=running 1=end request 2=back to CCP */
 int32 Debug = 0;
-int32 Break = -1;
 int32 Step = -1;
 
 #ifdef iDEBUG
-FILE* iLogFile;
-char iLogBuffer[256];
-const char* iLogTxt;
+FILE* iLogFile = NULL;
 #endif
 
-/* increase R by val (to correctly implement refresh counter) if enabled */
+/* increase R by val (to correctly implement refresh counter) if enabled; Z80run() only
+   counts the M1 cycles, which are added to R when it is read (R_NOW) or the registers spilled */
 #ifdef DO_INCR
-#define INCR(val) IR = (IR & ~0x3f) | ((IR + (val)) & 0x3f)
+uint32 M1count = 0;	/* M1 cycles run, brought up to date at every BIOS/BDOS call (see IDLE_GAP) */
+#define INCR(val) M1 += (val)
+#define R_NOW do { IR = (IR & ~0x3f) | ((IR + M1) & 0x3f); M1 = 0; } while (0)
 #else
 #define INCR(val) ;
+#define R_NOW ;
+#endif
+
+/* count the T-states taken by each instruction (see DO_CYCLES in globals.h) if enabled */
+#ifdef DO_CYCLES
+uint64 Cycles = 0;	/* T-states executed since power up */
+#define CYCLES(val) Cycles += (val)
+#define FETCH(t) (op = RAM_PP(PC), CYCLES(t[op]), op)
+#else
+#define CYCLES(val) ;
+#define FETCH(t) RAM_PP(PC)
+#endif
+
+/* count the instructions executed (shown by PROFILE) if enabled */
+#ifdef PROFILE
+uint64 Instrs = 0;	/* Instructions executed since power up */
+#ifdef PAIRS
+#define INSTR do { ++Instrs; Z80pair(GET_BYTE(PC)); } while (0)
+#else
+#define INSTR ++Instrs
+#endif
+#else
+#define INSTR ;
+#endif
+
+/*	Opcode pair histogram
+
+	Counts how often each opcode follows another (prefixed instructions count by their
+	prefix), to pick the pairs worth fusing (see FUSION). The counts live in a small open
+	addressing table, pairs that find no room in it are only counted as lost.
+*/
+#if defined(PROFILE) && defined(PAIRS)
+typedef struct {
+	uint16 pair;				/* previous opcode << 8 | opcode */
+	uint32 count;				/* 0 for an empty slot */
+} pair_t;
+
+static pair_t pairTable[PAIRS];
+static uint32 pairsLost;
+static uint16 pairLast;
+
+static void Z80pair(uint8 op) {
+	uint16 pair = pairLast | op;
+	uint32 i = ((pair * 40503) >> 4) & (PAIRS - 1), n;
+
+	pairLast = op << 8;
+	for (n = 0; n < 8; ++n, i = (i + 1) & (PAIRS - 1)) {
+		if (pairTable[i].pair == pair && pairTable[i].count) {
+			++pairTable[i].count;
+			return;
+		}
+		if (!pairTable[i].count) {
+			pairTable[i].pair = pair;
+			pairTable[i].count = 1;
+			return;
+		}
+	}
+	++pairsLost;
+}
+
+/* prints the most frequent pairs and starts counting again */
+void Z80pairsShow(void) {
+	uint32 i, n, best;
+
+	_puts("Opcode pairs (lost ");
+	_putdec64(pairsLost);
+	_puts("):\r\n");
+	for (n = 0; n < 16; ++n) {
+		best = 0;
+		for (i = 1; i < PAIRS; ++i)
+			if (pairTable[i].count > pairTable[best].count)
+				best = i;
+		if (!pairTable[best].count)
+			break;
+		_puts("  ");
+		_puthex8(pairTable[best].pair >> 8);
+		_putcon(' ');
+		_puthex8(pairTable[best].pair & 0xff);
+		_puts(": ");
+		_putdec64(pairTable[best].count);
+		_puts("\r\n");
+		pairTable[best].count = 0;
+	}
+	memset(pairTable, 0, sizeof(pairTable));
+	pairsLost = 0;
+}
+#endif
+
+/* slow the emulation down to a THROTTLE Hz Z80 (see globals.h) if enabled */
+#if defined(DO_CYCLES) && defined(THROTTLE)
+static uint64 throttleNext = 0;		/* Cycles value of the next check */
+static uint64 throttleCycles = 0;	/* Cycles value already accounted for in throttleTime */
+static uint32 throttleTime = 0;		/* micros() value when throttleCycles should be reached */
+
+static void Z80throttle(void) {
+	uint32 due = (uint32)((Cycles - throttleCycles) * 1000000 / THROTTLE);	/* microseconds the new T-states should take */
+	int32 ahead;
+
+	if (!throttleTime)
+		throttleTime = micros();
+	throttleTime += due;
+	throttleCycles += (uint64)due * THROTTLE / 1000000;
+	ahead = (int32)(throttleTime - micros());
+	if (ahead > 0)
+		delayMicroseconds(ahead);
+	else if (ahead < -100000)	/* more than 100ms behind (disk access, etc), do not try to catch up */
+		throttleTime = micros();
+	throttleNext = Cycles + THROTTLE / 1000;	/* check again in about 1ms of Z80 time */
+}
+#define THROTTLE_CHECK if (Cycles >= throttleNext) Z80throttle()
+#else
+#define THROTTLE_CHECK ;
+#endif
+
+/*	Sleeping through HALT (see HALT_WAIT in globals.h)
+
+	Nothing in the emulator raises interrupts, so a HALT used to end the program. With
+	HALT_WAIT, a HALT with interrupts enabled is taken as waiting for the next event instead:
+	the host sleeps (WFE on the RP2040) until a key arrives or HALT_WAIT ms pass, the timer
+	tick, and the CPU then carries on after the HALT as if an interrupt had been served.
+	The T-states the CPU would have spent halted are counted at THROTTLE (or 4MHz) and,
+	with DO_CYCLES, added to Cycles so guest time keeps pace with the host.
+*/
+#ifdef HALT_WAIT
+#ifdef THROTTLE
+#define HALT_HZ THROTTLE
+#else
+#define HALT_HZ 4000000
+#endif
+uint32 haltCount = 0;		/* HALTs slept through */
+uint64 haltCycles = 0;		/* T-states skipped while halted */
+
+static void Z80halt(void) {
+	uint32 start = micros();
+	uint64 skipped;
+
+	_idlewait(HALT_WAIT);
+	skipped = (uint64)(micros() - start) * HALT_HZ / 1000000;
+	haltCount++;
+	haltCycles += skipped;
+	CYCLES(skipped);
+}
+#endif
+
+/* threaded dispatch and the block cache need labels as values (see THREADED and BLOCK_CACHE in globals.h),
+   the debug builds always use the switch, as they need to run code between instructions */
+#if defined(THREADED) && defined(__GNUC__) && !defined(DEBUG) && !defined(iDEBUG)
+#define Z80_THREADED
+#ifdef BLOCK_CACHE
+#define Z80_BLOCKS
+#ifdef FUSION
+#define Z80_FUSION
+#endif
+#endif
+#endif
+
+/*	Predecoded block cache
+
+	Runs of straight-line code are decoded once into arrays of micro-ops, each holding the
+	handler of one instruction, its address and the number of opcode bytes, so hot loops run
+	without fetching and dispatching their opcodes again. A micro-op is only used while PC
+	matches its address, so a taken branch simply leaves the block. Guest writes to cached
+	code (PUT_BYTE/PUT_WORD) invalidate the blocks holding it, and as the BIOS/BDOS and the
+	host can load code behind the CPU's back, their calls and Z80run() flush the whole cache.
+*/
+#ifdef Z80_BLOCKS
+#define BLOCK_UOPS	15			/* most instructions in a block */
+#define BLOCK_END	0x80000000	/* address of the micro-op ending a block */
+
+typedef struct {
+	const void* handler;
+	uint32 pc;					/* address of the instruction */
+	uint8 skip;					/* opcode bytes before its operands (prefix included) */
+	uint8 cycles;				/* T-states added on dispatch (see DO_CYCLES) */
+	uint8 flags;				/* F must be up to date first (see LAZY_FLAGS) */
+} uop_t;
+
+typedef struct {
+	uint32 start, end;			/* memory decoded into the block */
+	uop_t uop[BLOCK_UOPS + 1];	/* the last valid one is followed by a BLOCK_END one */
+} block_t;
+
+static block_t blockCache[BLOCK_CACHE];
+static uint8 blockMap[0x10000 / 64];	/* one bit for each 8 bytes of memory decoded into blocks */
+static const uop_t blockNone = { 0, BLOCK_END, 0, 0, 0 };
+static uint32 blockHits, blockMisses, blockInvalidations, blockFlushes;
+
+static void Z80blockFlush(void) {
+	block_t* b;
+
+	for (b = blockCache; b < blockCache + BLOCK_CACHE; ++b)
+		b->uop[0].pc = BLOCK_END;
+	memset(blockMap, 0, sizeof(blockMap));
+	++blockFlushes;
+}
+
+static void Z80blockInvalidate(uint32 Addr) {
+	uint32 line = Addr & ~7;
+	block_t* b;
+	uop_t* u;
+
+	for (b = blockCache; b < blockCache + BLOCK_CACHE; ++b) {
+		if (b->uop[0].pc != BLOCK_END && b->start < line + 8 && line < b->end) {
+			for (u = b->uop; u->pc != BLOCK_END; ++u)
+				u->pc = BLOCK_END;	/* also stops the block if it is the one running */
+			++blockInvalidations;
+		}
+	}
+	blockMap[Addr >> 6] &= ~(1 << ((Addr >> 3) & 7));
+}
+
+/* invalidate the blocks holding any of the len bytes written from Addr (len > 0, no wrap around) */
+static void Z80blockInvalidateRange(uint32 Addr, uint32 len) {
+	uint32 line;
+
+	for (line = Addr >> 3; line <= (Addr + len - 1) >> 3; ++line)
+		if (blockMap[line >> 3] & (1 << (line & 7)))
+			Z80blockInvalidate(line << 3);
+}
+#define BLOCK_WRITE(a) do { if (blockMap[(a) >> 6] & (1 << (((a) >> 3) & 7))) Z80blockInvalidate(a); } while (0)
+#define BLOCK_WRITES(a, len) Z80blockInvalidateRange(a, len)
+#define BLOCK_FLUSH Z80blockFlush()
+#else
+#define BLOCK_WRITE(a) ;
+#define BLOCK_WRITES(a, len) ;
+#define BLOCK_FLUSH ;
 #endif
 
 /*
@@ -45,6 +271,7 @@ const char* iLogTxt;
 */
 void cpu_out(const uint32 Port, const uint32 Value) {
 	if (Port == 0xFF) {
+		BLOCK_FLUSH;
 		_Bios();
 	} else {
 		_HardwareOut(Port, Value);
@@ -54,6 +281,7 @@ void cpu_out(const uint32 Port, const uint32 Value) {
 uint32 cpu_in(const uint32 Port) {
 	uint32 Result;
 	if (Port == 0xFF) {
+		BLOCK_FLUSH;
 		_Bdos();
 		Result = HIGH_REGISTER(AF);
 	} else {
@@ -89,6 +317,44 @@ uint32 cpu_in(const uint32 Port) {
 #define SET_PV      (SET_PVS(sum))
 #define SET_PV2(x)  ((temp == (x)) << 2)
 
+/*	Lazy flags (see LAZY_FLAGS in globals.h)
+
+	The unprefixed ADD, SUB and CP only store their result in A and remember their operands.
+	F is worked out by FLAGS_NOW once the next instruction reads it or changes only part of it
+	(flagsUsedTable), before any prefixed instruction and before the registers leave Z80run().
+*/
+#ifdef LAZY_FLAGS
+#define LAZY_ADD    1
+#define LAZY_SUB    2
+#define LAZY_CP     3
+
+#define ADD_FLAGS do { SET_HIGH_REGISTER(AF, sum); lazy = LAZY_ADD; lazyAcu = acu; lazyTemp = temp; } while (0)
+#define SUB_FLAGS do { SET_HIGH_REGISTER(AF, sum); lazy = LAZY_SUB; lazyAcu = acu; lazyTemp = temp; } while (0)
+#define CP_FLAGS  do { lazy = LAZY_CP; lazyAcu = acu; lazyTemp = temp; } while (0)
+#define FLAGS_NOW do {                                                      \
+    if (lazy) {                                                             \
+        sum = lazy == LAZY_ADD ? lazyAcu + lazyTemp : lazyAcu - lazyTemp;   \
+        cbits = lazyAcu ^ lazyTemp ^ sum;                                   \
+        if (lazy == LAZY_ADD)                                               \
+            temp = addTable[sum] | cbitsTable[cbits] | (SET_PV);            \
+        else if (lazy == LAZY_SUB)                                          \
+            temp = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV); \
+        else                                                                \
+            temp = cpTable[sum & 0xff] | (lazyTemp & 0x28) |                \
+                (SET_PV) | cbits2Table[cbits & 0x1ff];                      \
+        SET_LOW_REGISTER(AF, temp);     /* A may have been loaded since */  \
+        lazy = 0;                                                           \
+    }                                                                       \
+} while (0)
+#define FLAGS_CHECK(used) if (lazy && (used)) FLAGS_NOW
+#else
+#define ADD_FLAGS AF = addTable[sum] | cbitsTable[cbits] | (SET_PV)
+#define SUB_FLAGS AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV)
+#define CP_FLAGS  AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) | (SET_PV) | cbits2Table[cbits & 0x1ff]
+#define FLAGS_NOW ;
+#define FLAGS_CHECK(used) ;
+#endif
+
 #define POP(x)  {                               \
     uint32 y = RAM_PP(SP);             \
     x = y + (RAM_PP(SP) << 8);                  \
@@ -102,11 +368,28 @@ uint32 cpu_in(const uint32 Port) {
     }                                           \
 }
 
+#define JRC(cond) {                             \
+    if (cond) {                                 \
+        PC += (int8)GET_BYTE(PC) + 1;           \
+        CYCLES(5);                              \
+    } else {                                    \
+        ++PC;                                   \
+    }                                           \
+}
+
+#define RETC(cond) {                            \
+    if (cond) {                                 \
+        POP(PC);                                \
+        CYCLES(6);                              \
+    }                                           \
+}
+
 #define CALLC(cond) {                           \
     if (cond) {                                 \
         uint32 adrr = GET_WORD(PC);    \
         PUSH(PC + 2);                           \
         PC = adrr;                              \
+        CYCLES(7);                              \
     } else {                                    \
         PC += 2;                                \
     }                                           \
@@ -139,7 +422,7 @@ cpTable[i]              0..255  (i & 0x80) | (((i & 0xff) == 0) << 6)
 */
 
 /* parityTable[i] = (number of 1's in i is odd) ? 0 : 4, i = 0..255 */
-static const uint8 parityTable[256] = {
+static const uint8 parityTable[256] SRAM_DATA = {
 	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
 	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
 	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
@@ -159,7 +442,7 @@ static const uint8 parityTable[256] = {
 };
 
 /* incTable[i] = (i & 0xa8) | (((i & 0xff) == 0) << 6) | (((i & 0xf) == 0) << 4), i = 0..256 */
-static const uint8 incTable[257] = {
+static const uint8 incTable[257] SRAM_DATA = {
 	80,  0,  0,  0,  0,  0,  0,  0,  8,  8,  8,  8,  8,  8,  8,  8,
 	16,  0,  0,  0,  0,  0,  0,  0,  8,  8,  8,  8,  8,  8,  8,  8,
 	48, 32, 32, 32, 32, 32, 32, 32, 40, 40, 40, 40, 40, 40, 40, 40,
@@ -179,7 +462,7 @@ static const uint8 incTable[257] = {
 };
 
 /* decTable[i] = (i & 0xa8) | (((i & 0xff) == 0) << 6) | (((i & 0xf) == 0xf) << 4) | 2, i = 0..255 */
-static const uint8 decTable[256] = {
+static const uint8 decTable[256] SRAM_DATA = {
 	66,  2,  2,  2,  2,  2,  2,  2, 10, 10, 10, 10, 10, 10, 10, 26,
 	2,  2,  2,  2,  2,  2,  2,  2, 10, 10, 10, 10, 10, 10, 10, 26,
 	34, 34, 34, 34, 34, 34, 34, 34, 42, 42, 42, 42, 42, 42, 42, 58,
@@ -199,7 +482,7 @@ static const uint8 decTable[256] = {
 };
 
 /* cbitsTable[i] = (i & 0x10) | ((i >> 8) & 1), i = 0..511 */
-static const uint8 cbitsTable[512] = {
+static const uint8 cbitsTable[512] SRAM_DATA = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -235,7 +518,7 @@ static const uint8 cbitsTable[512] = {
 };
 
 /* cbitsDup8Table[i] = (i & 0x10) | ((i >> 8) & 1) | ((i & 0xff) << 8) | (i & 0xa8) | (((i & 0xff) == 0) << 6), i = 0..511 */
-static const uint16 cbitsDup8Table[512] = {
+static const uint16 cbitsDup8Table[512] SRAM_DATA = {
 	0x0040,0x0100,0x0200,0x0300,0x0400,0x0500,0x0600,0x0700,
 	0x0808,0x0908,0x0a08,0x0b08,0x0c08,0x0d08,0x0e08,0x0f08,
 	0x1010,0x1110,0x1210,0x1310,0x1410,0x1510,0x1610,0x1710,
@@ -303,7 +586,7 @@ static const uint16 cbitsDup8Table[512] = {
 };
 
 /* cbitsDup16Table[i] = (i & 0x10) | ((i >> 8) & 1) | (i & 0x28), i = 0..511 */
-static const uint8 cbitsDup16Table[512] = {
+static const uint8 cbitsDup16Table[512] SRAM_DATA = {
 	0, 0, 0, 0, 0, 0, 0, 0, 8, 8, 8, 8, 8, 8, 8, 8,
 	16,16,16,16,16,16,16,16,24,24,24,24,24,24,24,24,
 	32,32,32,32,32,32,32,32,40,40,40,40,40,40,40,40,
@@ -339,7 +622,7 @@ static const uint8 cbitsDup16Table[512] = {
 };
 
 /* cbits2Table[i] = (i & 0x10) | ((i >> 8) & 1) | 2, i = 0..511 */
-static const uint8 cbits2Table[512] = {
+static const uint8 cbits2Table[512] SRAM_DATA = {
 	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
 	18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
 	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
@@ -375,7 +658,7 @@ static const uint8 cbits2Table[512] = {
 };
 
 /* rrcaTable[i] = ((i & 1) << 15) | ((i >> 1) << 8) | ((i >> 1) & 0x28) | (i & 1), i = 0..255 */
-static const uint16 rrcaTable[256] = {
+static const uint16 rrcaTable[256] SRAM_DATA = {
 	0x0000,0x8001,0x0100,0x8101,0x0200,0x8201,0x0300,0x8301,
 	0x0400,0x8401,0x0500,0x8501,0x0600,0x8601,0x0700,0x8701,
 	0x0808,0x8809,0x0908,0x8909,0x0a08,0x8a09,0x0b08,0x8b09,
@@ -411,7 +694,7 @@ static const uint16 rrcaTable[256] = {
 };
 
 /* rraTable[i] = ((i >> 1) << 8) | ((i >> 1) & 0x28) | (i & 1), i = 0..255 */
-static const uint16 rraTable[256] = {
+static const uint16 rraTable[256] SRAM_DATA = {
 	0x0000,0x0001,0x0100,0x0101,0x0200,0x0201,0x0300,0x0301,
 	0x0400,0x0401,0x0500,0x0501,0x0600,0x0601,0x0700,0x0701,
 	0x0808,0x0809,0x0908,0x0909,0x0a08,0x0a09,0x0b08,0x0b09,
@@ -447,7 +730,7 @@ static const uint16 rraTable[256] = {
 };
 
 /* addTable[i] = ((i & 0xff) << 8) | (i & 0xa8) | (((i & 0xff) == 0) << 6), i = 0..511 */
-static const uint16 addTable[512] = {
+static const uint16 addTable[512] SRAM_DATA = {
 	0x0040,0x0100,0x0200,0x0300,0x0400,0x0500,0x0600,0x0700,
 	0x0808,0x0908,0x0a08,0x0b08,0x0c08,0x0d08,0x0e08,0x0f08,
 	0x1000,0x1100,0x1200,0x1300,0x1400,0x1500,0x1600,0x1700,
@@ -515,7 +798,7 @@ static const uint16 addTable[512] = {
 };
 
 /* subTable[i] = ((i & 0xff) << 8) | (i & 0xa8) | (((i & 0xff) == 0) << 6) | 2, i = 0..255 */
-static const uint16 subTable[256] = {
+static const uint16 subTable[256] SRAM_DATA = {
 	0x0042,0x0102,0x0202,0x0302,0x0402,0x0502,0x0602,0x0702,
 	0x080a,0x090a,0x0a0a,0x0b0a,0x0c0a,0x0d0a,0x0e0a,0x0f0a,
 	0x1002,0x1102,0x1202,0x1302,0x1402,0x1502,0x1602,0x1702,
@@ -551,7 +834,7 @@ static const uint16 subTable[256] = {
 };
 
 /* andTable[i] = (i << 8) | (i & 0xa8) | ((i == 0) << 6) | 0x10 | parityTable[i], i = 0..255 */
-static const uint16 andTable[256] = {
+static const uint16 andTable[256] SRAM_DATA = {
 	0x0054,0x0110,0x0210,0x0314,0x0410,0x0514,0x0614,0x0710,
 	0x0818,0x091c,0x0a1c,0x0b18,0x0c1c,0x0d18,0x0e18,0x0f1c,
 	0x1010,0x1114,0x1214,0x1310,0x1414,0x1510,0x1610,0x1714,
@@ -587,7 +870,7 @@ static const uint16 andTable[256] = {
 };
 
 /* xororTable[i] = (i << 8) | (i & 0xa8) | ((i == 0) << 6) | parityTable[i], i = 0..255 */
-static const uint16 xororTable[256] = {
+static const uint16 xororTable[256] SRAM_DATA = {
 	0x0044,0x0100,0x0200,0x0304,0x0400,0x0504,0x0604,0x0700,
 	0x0808,0x090c,0x0a0c,0x0b08,0x0c0c,0x0d08,0x0e08,0x0f0c,
 	0x1000,0x1104,0x1204,0x1300,0x1404,0x1500,0x1600,0x1704,
@@ -623,7 +906,7 @@ static const uint16 xororTable[256] = {
 };
 
 /* rotateShiftTable[i] = (i & 0xa8) | (((i & 0xff) == 0) << 6) | parityTable[i & 0xff], i = 0..255 */
-static const uint8 rotateShiftTable[256] = {
+static const uint8 rotateShiftTable[256] SRAM_DATA = {
 	68,  0,  0,  4,  0,  4,  4,  0,  8, 12, 12,  8, 12,  8,  8, 12,
 	0,  4,  4,  0,  4,  0,  0,  4, 12,  8,  8, 12,  8, 12, 12,  8,
 	32, 36, 36, 32, 36, 32, 32, 36, 44, 40, 40, 44, 40, 44, 44, 40,
@@ -643,7 +926,7 @@ static const uint8 rotateShiftTable[256] = {
 };
 
 /* incZ80Table[i] = (i & 0xa8) | (((i & 0xff) == 0) << 6) | (((i & 0xf) == 0) << 4) | ((i == 0x80) << 2), i = 0..256 */
-static const uint8 incZ80Table[257] = {
+static const uint8 incZ80Table[257] SRAM_DATA = {
 	80,  0,  0,  0,  0,  0,  0,  0,  8,  8,  8,  8,  8,  8,  8,  8,
 	16,  0,  0,  0,  0,  0,  0,  0,  8,  8,  8,  8,  8,  8,  8,  8,
 	48, 32, 32, 32, 32, 32, 32, 32, 40, 40, 40, 40, 40, 40, 40, 40,
@@ -663,7 +946,7 @@ static const uint8 incZ80Table[257] = {
 };
 
 /* decZ80Table[i] = (i & 0xa8) | (((i & 0xff) == 0) << 6) | (((i & 0xf) == 0xf) << 4) | ((i == 0x7f) << 2) | 2, i = 0..255 */
-static const uint8 decZ80Table[256] = {
+static const uint8 decZ80Table[256] SRAM_DATA = {
 	66,  2,  2,  2,  2,  2,  2,  2, 10, 10, 10, 10, 10, 10, 10, 26,
 	2,  2,  2,  2,  2,  2,  2,  2, 10, 10, 10, 10, 10, 10, 10, 26,
 	34, 34, 34, 34, 34, 34, 34, 34, 42, 42, 42, 42, 42, 42, 42, 58,
@@ -683,7 +966,7 @@ static const uint8 decZ80Table[256] = {
 };
 
 /* cbitsZ80Table[i] = (i & 0x10) | (((i >> 6) ^ (i >> 5)) & 4) | ((i >> 8) & 1), i = 0..511 */
-static const uint8 cbitsZ80Table[512] = {
+static const uint8 cbitsZ80Table[512] SRAM_DATA = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -719,7 +1002,7 @@ static const uint8 cbitsZ80Table[512] = {
 };
 
 /* cbitsZ80DupTable[i] = (i & 0x10) | (((i >> 6) ^ (i >> 5)) & 4) | ((i >> 8) & 1) | (i & 0xa8), i = 0..511 */
-static const uint8 cbitsZ80DupTable[512] = {
+static const uint8 cbitsZ80DupTable[512] SRAM_DATA = {
 	0,  0,  0,  0,  0,  0,  0,  0,  8,  8,  8,  8,  8,  8,  8,  8,
 	16, 16, 16, 16, 16, 16, 16, 16, 24, 24, 24, 24, 24, 24, 24, 24,
 	32, 32, 32, 32, 32, 32, 32, 32, 40, 40, 40, 40, 40, 40, 40, 40,
@@ -755,7 +1038,7 @@ static const uint8 cbitsZ80DupTable[512] = {
 };
 
 /* cbits2Z80Table[i] = (i & 0x10) | (((i >> 6) ^ (i >> 5)) & 4) | ((i >> 8) & 1) | 2, i = 0..511 */
-static const uint8 cbits2Z80Table[512] = {
+static const uint8 cbits2Z80Table[512] SRAM_DATA = {
 	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
 	18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,18,
 	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
@@ -791,7 +1074,7 @@ static const uint8 cbits2Z80Table[512] = {
 };
 
 /* cbits2Z80DupTable[i] = (i & 0x10) | (((i >> 6) ^ (i >> 5)) & 4) | ((i >> 8) & 1) | 2 | (i & 0xa8), i = 0..511 */
-static const uint8 cbits2Z80DupTable[512] = {
+static const uint8 cbits2Z80DupTable[512] SRAM_DATA = {
 	2,  2,  2,  2,  2,  2,  2,  2, 10, 10, 10, 10, 10, 10, 10, 10,
 	18, 18, 18, 18, 18, 18, 18, 18, 26, 26, 26, 26, 26, 26, 26, 26,
 	34, 34, 34, 34, 34, 34, 34, 34, 42, 42, 42, 42, 42, 42, 42, 42,
@@ -827,7 +1110,7 @@ static const uint8 cbits2Z80DupTable[512] = {
 };
 
 /* negTable[i] = (((i & 0x0f) != 0) << 4) | ((i == 0x80) << 2) | 2 | (i != 0), i = 0..255 */
-static const uint8 negTable[256] = {
+static const uint8 negTable[256] SRAM_DATA = {
 	2,19,19,19,19,19,19,19,19,19,19,19,19,19,19,19,
 	3,19,19,19,19,19,19,19,19,19,19,19,19,19,19,19,
 	3,19,19,19,19,19,19,19,19,19,19,19,19,19,19,19,
@@ -847,7 +1130,7 @@ static const uint8 negTable[256] = {
 };
 
 /* rrdrldTable[i] = (i << 8) | (i & 0xa8) | (((i & 0xff) == 0) << 6) | parityTable[i], i = 0..255 */
-static const uint16 rrdrldTable[256] = {
+static const uint16 rrdrldTable[256] SRAM_DATA = {
 	0x0044,0x0100,0x0200,0x0304,0x0400,0x0504,0x0604,0x0700,
 	0x0808,0x090c,0x0a0c,0x0b08,0x0c0c,0x0d08,0x0e08,0x0f0c,
 	0x1000,0x1104,0x1204,0x1300,0x1404,0x1500,0x1600,0x1704,
@@ -883,7 +1166,7 @@ static const uint16 rrdrldTable[256] = {
 };
 
 /* cpTable[i] = (i & 0x80) | (((i & 0xff) == 0) << 6), i = 0..255 */
-static const uint8 cpTable[256] = {
+static const uint8 cpTable[256] SRAM_DATA = {
 	64,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
 	0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
 	0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
@@ -902,6 +1185,130 @@ static const uint8 cpTable[256] = {
 	128,128,128,128,128,128,128,128,128,128,128,128,128,128,128,128,
 };
 
+#ifdef LAZY_FLAGS
+/* flagsUsedTable[i] = 1 if unprefixed opcode i reads F or changes only part of it (prefixes included) */
+static const uint8 flagsUsedTable[256] SRAM_DATA = {
+	0, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 0, 1, 1, 0, 1,
+	0, 0, 0, 0, 1, 1, 0, 1, 0, 1, 0, 0, 1, 1, 0, 1,
+	1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 0, 1, 1, 0, 1,
+	1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 0, 1, 1, 0, 1,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1,
+	1, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1, 0, 1, 0,
+	1, 0, 1, 1, 1, 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0,
+	1, 1, 1, 0, 1, 1, 1, 0, 1, 0, 1, 0, 1, 1, 0, 0,
+};
+#endif
+
+#ifdef DO_CYCLES
+/* cyclesTable[i] = T-states of unprefixed opcode i (0 for the CB/DD/ED/FD prefixes) */
+static const uint8 cyclesTable[256] SRAM_DATA = {
+	 4,10, 7, 6, 4, 4, 7, 4, 4,11, 7, 6, 4, 4, 7, 4,
+	 8,10, 7, 6, 4, 4, 7, 4,12,11, 7, 6, 4, 4, 7, 4,
+	 7,10,16, 6, 4, 4, 7, 4, 7,11,16, 6, 4, 4, 7, 4,
+	 7,10,13, 6,11,11,10, 4, 7,11,13, 6, 4, 4, 7, 4,
+	 4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	 4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	 4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	 7, 7, 7, 7, 7, 7, 4, 7, 4, 4, 4, 4, 4, 4, 7, 4,
+	 4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	 4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	 4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	 4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,
+	 5,10,10,10,10,11, 7,11, 5,10,10, 0,10,10, 7,11,
+	 5,10,10,11,10,11, 7,11, 5, 4,10,11,10, 0, 7,11,
+	 5,10,10,19,10,11, 7,11, 5, 4,10, 4,10, 0, 7,11,
+	 5,10,10, 4,10,11, 7,11, 5, 6,10, 4,10, 0, 7,11,
+};
+
+/* cyclesCBTable[i] = T-states of opcode CB i */
+static const uint8 cyclesCBTable[256] SRAM_DATA = {
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,12, 8, 8, 8, 8, 8, 8, 8,12, 8,
+	 8, 8, 8, 8, 8, 8,12, 8, 8, 8, 8, 8, 8, 8,12, 8,
+	 8, 8, 8, 8, 8, 8,12, 8, 8, 8, 8, 8, 8, 8,12, 8,
+	 8, 8, 8, 8, 8, 8,12, 8, 8, 8, 8, 8, 8, 8,12, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+	 8, 8, 8, 8, 8, 8,15, 8, 8, 8, 8, 8, 8, 8,15, 8,
+};
+
+/* cyclesEDTable[i] = T-states of opcode ED i */
+static const uint8 cyclesEDTable[256] SRAM_DATA = {
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	12,12,15,20, 8,14, 8, 9,12,12,15,20, 8,14, 8, 9,
+	12,12,15,20, 8,14, 8, 9,12,12,15,20, 8,14, 8, 9,
+	12,12,15,20, 8,14, 8,18,12,12,15,20, 8,14, 8,18,
+	12,12,15,20, 8,14, 8, 8,12,12,15,20, 8,14, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	16,16,16,16, 8, 8, 8, 8,16,16,16,16, 8, 8, 8, 8,
+	16,16,16,16, 8, 8, 8, 8,16,16,16,16, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+};
+
+/* cyclesXXTable[i] = T-states of opcode DD i / FD i (4 when the prefix is ignored, 0 for DD CB / FD CB) */
+static const uint8 cyclesXXTable[256] SRAM_DATA = {
+	 4, 4, 4, 4, 4, 4, 4, 4, 4,15, 4, 4, 4, 4, 4, 4,
+	 4, 4, 4, 4, 4, 4, 4, 4, 4,15, 4, 4, 4, 4, 4, 4,
+	 4,14,20,10, 8, 8,11, 4, 4,15,20,10, 8, 8,11, 4,
+	 4, 4, 4, 4,23,23,19, 4, 4,15, 4, 4, 4, 4, 4, 4,
+	 4, 4, 4, 4, 8, 8,19, 4, 4, 4, 4, 4, 8, 8,19, 4,
+	 4, 4, 4, 4, 8, 8,19, 4, 4, 4, 4, 4, 8, 8,19, 4,
+	 8, 8, 8, 8, 8, 8,19, 8, 8, 8, 8, 8, 8, 8,19, 8,
+	19,19,19,19,19,19, 4,19, 4, 4, 4, 4, 8, 8,19, 4,
+	 4, 4, 4, 4, 8, 8,19, 4, 4, 4, 4, 4, 8, 8,19, 4,
+	 4, 4, 4, 4, 8, 8,19, 4, 4, 4, 4, 4, 8, 8,19, 4,
+	 4, 4, 4, 4, 8, 8,19, 4, 4, 4, 4, 4, 8, 8,19, 4,
+	 4, 4, 4, 4, 8, 8,19, 4, 4, 4, 4, 4, 8, 8,19, 4,
+	 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 4, 4, 4,
+	 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	 4,14, 4,23, 4,15, 4, 4, 4, 8, 4, 4, 4, 4, 4, 4,
+	 4, 4, 4, 4, 4, 4, 4, 4, 4,10, 4, 4, 4, 4, 4, 4,
+};
+
+/* cyclesXCBTable[i] = T-states of opcode DD CB dd i / FD CB dd i */
+static const uint8 cyclesXCBTable[256] SRAM_DATA = {
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,
+	20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,
+	20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,
+	20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+};
+#endif
+
 #if defined(DEBUG) || defined(iDEBUG)
 static const char* Mnemonics[256] =
 {
@@ -1127,12 +1534,221 @@ static const char* CPMCalls[41] =
 int32 Watch = -1;
 #endif
 
+#ifdef DEBUG
+/*	Breakpoints and write watchpoints
+
+	Both are bitmaps over the 64K address space. WatchPages has one bit per 256 byte page,
+	so a write only looks up WatchMap in a page holding a watchpoint. The instruction loop
+	only tests Armed, which stays 0 while there are no breakpoints, watchpoints or step.
+*/
+#define ARM_BREAK	1
+#define ARM_WATCH	2
+#define ARM_STEP	4
+
+#define BIT_TEST(map, a)	((map)[(a) >> 3] & (1 << ((a) & 7)))
+#define BIT_SET(map, a)		(map)[(a) >> 3] |= (1 << ((a) & 7))
+#define BIT_CLEAR(map, a)	(map)[(a) >> 3] &= ~(1 << ((a) & 7))
+
+uint8 BreakMap[8192];
+uint8 WatchMap[8192];
+uint8 WatchPages[32];
+uint32 BreakCount = 0;
+uint32 WatchCount = 0;
+uint8 Armed = 0;
+
+static void Z80arm(void) {
+	Armed = (BreakCount ? ARM_BREAK : 0) | (WatchCount ? ARM_WATCH : 0) | (Step != -1 ? ARM_STEP : 0);
+}
+
+void Z80breakSet(uint16 a) {
+	if (!BIT_TEST(BreakMap, a)) {
+		BIT_SET(BreakMap, a);
+		++BreakCount;
+	}
+	Z80arm();
+}
+
+void Z80breakClear(uint16 a) {
+	if (BIT_TEST(BreakMap, a)) {
+		BIT_CLEAR(BreakMap, a);
+		--BreakCount;
+	}
+	Z80arm();
+}
+
+void Z80watchSet(uint16 a) {
+	if (!BIT_TEST(WatchMap, a)) {
+		BIT_SET(WatchMap, a);
+		BIT_SET(WatchPages, a >> 8);
+		++WatchCount;
+	}
+	Z80arm();
+}
+
+void Z80watchClear(uint16 a) {
+	uint8 i;
+
+	if (BIT_TEST(WatchMap, a)) {
+		BIT_CLEAR(WatchMap, a);
+		--WatchCount;
+		for (i = 0; i < 32 && !WatchMap[(a & 0xff00) / 8 + i]; ++i);
+		if (i == 32)	/* nothing left to watch in this page */
+			BIT_CLEAR(WatchPages, a >> 8);
+	}
+	Z80arm();
+}
+
+void Z80breakReset(void) {
+	memset(BreakMap, 0, sizeof(BreakMap));
+	memset(WatchMap, 0, sizeof(WatchMap));
+	memset(WatchPages, 0, sizeof(WatchPages));
+	BreakCount = WatchCount = 0;
+	Z80arm();
+}
+
+/* Called on writes while watchpoints are armed, stops in the debugger after the instruction */
+static void Z80watch(uint16 a) {
+	if (BIT_TEST(WatchPages, a >> 8) && BIT_TEST(WatchMap, a)) {
+		_puts(":WATCH at ");
+		_puthex16(a);
+		_puts(":");
+		Debug = 1;
+	}
+}
+
+static void Z80watchRange(uint32 a, uint32 len) {
+	while (len--)
+		Z80watch(a++);
+}
+
+#define WATCH_WRITE(a) do { if (Armed & ARM_WATCH) Z80watch(a); } while (0)
+#define WATCH_WRITES(a, len) do { if (Armed & ARM_WATCH) Z80watchRange(a, len); } while (0)
+#else
+#define WATCH_WRITE(a) ;
+#define WATCH_WRITES(a, len) ;
+#endif
+
+#ifdef iDEBUG
+/*	Binary instruction trace
+
+	Each instruction adds one 16 byte entry to iTrace[], written to iDump.bin whenever the buffer
+	fills up and when Z80run() returns. Z80traceDecode() turns iDump.bin into the readable iDump.log
+	afterwards, so tracing costs little more than the stores.
+*/
+#define TRACE_ENTRIES 4096
+
+typedef struct {
+	uint16 pc;
+	uint8 op[4];				/* bytes at PC, enough for the longest instruction */
+	uint16 af, bc, de, hl, sp;	/* registers before it ran */
+} trace_t;
+
+trace_t iTrace[TRACE_ENTRIES];
+uint32 iTraceCount = 0;
+
+void Z80traceFlush(void) {
+	if (iTraceCount == 0)
+		return;
+	if (!iLogFile)
+		iLogFile = fopen("iDump.bin", "ab");
+	if (iLogFile) {
+		fwrite(iTrace, sizeof(trace_t), iTraceCount, iLogFile);
+		fflush(iLogFile);
+	}
+	iTraceCount = 0;
+}
+
+static inline void Z80trace(uint16 pc, uint16 af, uint16 bc, uint16 de, uint16 hl, uint16 sp) {
+	trace_t* t = &iTrace[iTraceCount];
+	t->pc = pc;
+	t->op[0] = _RamRead(pc);
+	t->op[1] = _RamRead((pc + 1) & 0xffff);
+	t->op[2] = _RamRead((pc + 2) & 0xffff);
+	t->op[3] = _RamRead((pc + 3) & 0xffff);
+	t->af = af; t->bc = bc; t->de = de; t->hl = hl; t->sp = sp;
+	if (++iTraceCount == TRACE_ENTRIES)
+		Z80traceFlush();
+}
+
+/* Same rendering as Disasm(), from the bytes kept in a trace entry */
+static void Z80traceText(FILE* out, const trace_t* t) {
+	const char* txt;
+	const uint8* op = t->op;
+	uint16 pos = t->pc;
+	char C = 0;
+
+	switch (*op) {
+	case 0xCB: txt = MnemonicsCB[op[1]]; op += 2; break;
+	case 0xED: txt = MnemonicsED[op[1]]; op += 2; break;
+	case 0xDD:
+	case 0xFD:
+		C = *op == 0xDD ? 'X' : 'Y';
+		if (op[1] != 0xCB) {
+			txt = MnemonicsXX[op[1]]; op += 2;
+		} else {
+			txt = MnemonicsXCB[op[3]]; op += 2;	/* DD CB dd op: the displacement comes first */
+		}
+		break;
+	default: txt = Mnemonics[*op++];
+	}
+	pos += op - t->op;
+	while (*txt != 0) {
+		switch (*txt) {
+		case '*':
+		case '^':
+			txt += 2;
+			fprintf(out, "%02X", *op++);
+			++pos;
+			break;
+		case '#':
+			txt += 2;
+			fprintf(out, "%02X%02X", op[1], op[0]);
+			op += 2;
+			pos += 2;
+			break;
+		case '@':
+			txt += 2;
+			++pos;
+			fprintf(out, "%04X", (uint16)(pos + (signed char)*op++));
+			break;
+		case '%':
+			fputc(C, out);
+			++txt;
+			break;
+		default:
+			fputc(*txt++, out);
+		}
+	}
+}
+
+/* Turns a binary trace into text, one instruction per line */
+int Z80traceDecode(const char* in, const char* out) {
+	FILE* fin = fopen(in, "rb");
+	FILE* fout = fopen(out, "w");
+	trace_t t;
+
+	if (!fin || !fout)
+		return(1);
+	while (fread(&t, sizeof(t), 1, fin) == 1) {
+		fprintf(fout, "%04X: %02X %02X %02X %02X  AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X  ",
+			t.pc, t.op[0], t.op[1], t.op[2], t.op[3], t.af, t.bc, t.de, t.hl, t.sp);
+		Z80traceText(fout, &t);
+		fputc('\n', fout);
+	}
+	fclose(fin);
+	fclose(fout);
+	return(0);
+}
+#endif
+
 /* Memory management    */
 static uint8 GET_BYTE(uint32 Addr) {
 	return _RamRead(Addr & ADDRMASK);
 }
 
 static void PUT_BYTE(uint32 Addr, uint32 Value) {
+	BLOCK_WRITE(Addr & ADDRMASK);
+	WATCH_WRITE(Addr & ADDRMASK);
 	_RamWrite(Addr & ADDRMASK, Value);
 }
 
@@ -1141,8 +1757,12 @@ static uint16 GET_WORD(uint32 a) {
 }
 
 static void PUT_WORD(uint32 Addr, uint32 Value) {
-	_RamWrite(Addr, Value);
-	_RamWrite(++Addr, Value >> 8);
+	BLOCK_WRITE(Addr & ADDRMASK);
+	BLOCK_WRITE((Addr + 1) & ADDRMASK);
+	WATCH_WRITE(Addr & ADDRMASK);
+	WATCH_WRITE((Addr + 1) & ADDRMASK);
+	_RamWrite(Addr & ADDRMASK, Value);
+	_RamWrite((Addr + 1) & ADDRMASK, Value >> 8);
 }
 
 #define RAM_MM(a)   GET_BYTE(a--)
@@ -1190,8 +1810,10 @@ static inline void Z80reset(void) {
 	IR = 0;
 	Status = 0;
 	Debug = 0;
-	Break = -1;
 	Step = -1;
+#ifdef DEBUG
+	Z80breakReset();
+#endif
 }
 
 #ifdef DEBUG
@@ -1389,15 +2011,60 @@ void Z80debug(void) {
 			_puts(" Addr: ");
 			res=scanf("%04x", &bpoint);
 			if (res) {
-				Break = bpoint;
-				_puts("Breakpoint set to ");
-				_puthex16(Break);
+				Z80breakSet(bpoint);
+				_puts("Breakpoint set at ");
+				_puthex16(bpoint);
 				_puts("\r\n");
 			}
 			break;
 		case 'C':
-			Break = -1;
-			_puts(" Breakpoint cleared\r\n");
+			_puts(" Addr: ");
+			res=scanf("%04x", &bpoint);
+			if (res) {
+				Z80breakClear(bpoint);
+				_puts("Breakpoint cleared at ");
+				_puthex16(bpoint);
+				_puts("\r\n");
+			}
+			break;
+		case 'M':
+			_puts(" Addr: ");
+			res=scanf("%04x", &bpoint);
+			if (res) {
+				Z80watchSet(bpoint);
+				_puts("Write watchpoint set at ");
+				_puthex16(bpoint);
+				_puts("\r\n");
+			}
+			break;
+		case 'U':
+			_puts(" Addr: ");
+			res=scanf("%04x", &bpoint);
+			if (res) {
+				Z80watchClear(bpoint);
+				_puts("Write watchpoint cleared at ");
+				_puthex16(bpoint);
+				_puts("\r\n");
+			}
+			break;
+		case 'K':
+			Z80breakReset();
+			_puts(" All breakpoints and watchpoints cleared\r\n");
+			break;
+		case 'S':
+			_puts("\r\nBreakpoints:");
+			for (bpoint = 0; bpoint < 0x10000; ++bpoint)
+				if (BIT_TEST(BreakMap, bpoint)) {
+					_putcon(' ');
+					_puthex16(bpoint);
+				}
+			_puts("\r\nWrite watchpoints:");
+			for (bpoint = 0; bpoint < 0x10000; ++bpoint)
+				if (BIT_TEST(WatchMap, bpoint)) {
+					_putcon(' ');
+					_puthex16(bpoint);
+				}
+			_puts("\r\n");
 			break;
 		case 'D':
 			_puts(" Addr: ");
@@ -1424,6 +2091,7 @@ void Z80debug(void) {
 			loop = FALSE;
 			Step = pos + 3; // This only works correctly with CALL
 							// If the called function messes with the stack, this will fail as well.
+			Z80arm();
 			Debug = 0;
 			break;
 		case 'W':
@@ -1451,8 +2119,12 @@ void Z80debug(void) {
 			_puts("  a - Dumps memory pointed by dmaAddr\r\n");
 			_puts("  l - Disassembles from current PC\r\n");
 			_puts("Uppercase commands:\r\n");
-			_puts("  B - Sets breakpoint at address\r\n");
-			_puts("  C - Clears breakpoint\r\n");
+			_puts("  B - Sets a breakpoint at address\r\n");
+			_puts("  C - Clears the breakpoint at address\r\n");
+			_puts("  M - Sets a write watchpoint at address\r\n");
+			_puts("  U - Clears the write watchpoint at address\r\n");
+			_puts("  K - Clears all breakpoints and watchpoints\r\n");
+			_puts("  S - Shows the breakpoints and watchpoints\r\n");
 			_puts("  D - Dumps memory at address\r\n");
 			_puts("  L - Disassembles at address\r\n");
 			_puts("  T - Steps over a call\r\n");
@@ -1465,254 +2137,631 @@ void Z80debug(void) {
 }
 #endif
 
-static inline void Z80run(void) {
+/*	Instruction dispatch
+
+	By default each opcode is decoded by a switch statement. With THREADED defined
+	(see globals.h) and a compiler supporting labels as values (GCC/Clang), every
+	handler jumps straight to the next one through a label table instead, which
+	removes the range check and gives each handler its own indirect branch.
+*/
+#ifdef Z80_THREADED
+#define DISPATCH(t, x)  goto *t##Table[x]; switch (0)
+#define OPCODE(t, x)    case x: t##_##x:
+#define OPDEFAULT(t)    default: t##_default:
+#ifdef Z80_BLOCKS
+#define NEXT do {                               \
+    if (Status)                                 \
+        goto end_decode;                        \
+    THROTTLE_CHECK;                             \
+    PCX = PC;                                   \
+    if ((uint32)PC != uop->pc)                  \
+        goto block_lookup;                      \
+    UOP_RUN;                                    \
+} while (0)
+#define UOP_RUN do {                            \
+    FLAGS_CHECK(uop->flags);                    \
+    INCR(uop->skip);                            \
+    CYCLES(uop->cycles);                        \
+    INSTR;                                      \
+    PC += uop->skip;                            \
+    goto *(uop++)->handler;                     \
+} while (0)
+#else
+#define NEXT do {                               \
+    if (Status)                                 \
+        goto end_decode;                        \
+    THROTTLE_CHECK;                             \
+    PCX = PC;                                   \
+    INCR(1);                                    \
+    INSTR;                                      \
+    FLAGS_CHECK(flagsUsedTable[GET_BYTE(PC)]);  \
+    goto *opTable[FETCH(cyclesTable)];          \
+} while (0)
+#endif
+#else
+#define DISPATCH(t, x)  switch (x)
+#define OPCODE(t, x)    case x:
+#define OPDEFAULT(t)    default:
+#define NEXT            break
+#endif
+
+#ifdef Z80_BLOCKS
+/* length of an unprefixed instruction */
+static uint8 Z80oplen(uint8 op) {
+	if ((op & 0xcf) == 0x01 || (op & 0xe7) == 0x22 || (op & 0xc7) == 0xc2 || (op & 0xc7) == 0xc4 || op == 0xc3 || op == 0xcd)
+		return 3;
+	if ((op & 0xc7) == 0x06 || (op & 0xc7) == 0xc6 || (op & 0xe7) == 0x20 || op == 0x10 || op == 0x18 || op == 0xcb || op == 0xd3 || op == 0xdb)
+		return 2;
+	return 1;
+}
+
+/* whether the IX/IY form of an instruction takes a displacement (replaces (HL)) */
+static uint8 Z80hasdisp(uint8 op) {
+	return (op >= 0x34 && op <= 0x36) || op == 0xcb || (op & 0xc7) == 0x86 ||
+		((op & 0xc0) == 0x40 && op != 0x76 && ((op & 0x07) == 0x06 || (op & 0xf8) == 0x70));
+}
+
+#ifdef DO_CYCLES
+#define UOP_CYCLES(t, x) u->cycles = t[x]
+#else
+#define UOP_CYCLES(t, x) u->cycles = 0
+#endif
+#ifdef LAZY_FLAGS
+#define UOP_FLAGS(x) u->flags = (x)
+#else
+#define UOP_FLAGS(x) u->flags = 0
+#endif
+
+/*	Superinstructions
+
+	With FUSION (see globals.h) the decoder turns these runs of unprefixed instructions into
+	a single micro-op, whose handler in Z80run() does all but the last one itself and then
+	jumps into the last one's handler, saving the dispatch in between. Only the last one may
+	take operands or branch and none of them ends a block. The list was chosen from the
+	PAIRS histogram of compilers, editors and BASIC; each entry needs a fuse_ handler.
+*/
+#ifdef Z80_FUSION
+#define FUSIONS											\
+	FUSE2(0x7e, 0x23)		/* LD A,(HL) / INC HL */	\
+	FUSE2(0x05, 0x20)		/* DEC B / JR NZ */			\
+	FUSE2(0x05, 0xc2)		/* DEC B / JP NZ */			\
+	FUSE2(0xb7, 0x20)		/* OR A / JR NZ */			\
+	FUSE2(0xb7, 0x28)		/* OR A / JR Z */			\
+	FUSE2(0xb7, 0xc2)		/* OR A / JP NZ */			\
+	FUSE2(0xb7, 0xca)		/* OR A / JP Z */			\
+	FUSE2(0xeb, 0x19)		/* EX DE,HL / ADD HL,DE */	\
+	FUSE2(0xc5, 0xd5)		/* PUSH BC / PUSH DE */		\
+	FUSE2(0xd1, 0xc1)		/* POP DE / POP BC */		\
+	FUSE3(0x78, 0xb1, 0x20)	/* LD A,B / OR C / JR NZ */	\
+	FUSE3(0x78, 0xb1, 0xc2)	/* LD A,B / OR C / JP NZ */
+
+#define FUSE2(a, b) { 2, a, b, 0 },
+#define FUSE3(a, b, c) { 3, a, b, c },
+static const uint8 fuseOps[][4] = { FUSIONS };	/* number of instructions, their opcodes */
+#undef FUSE2
+#undef FUSE3
+#define FUSE_COUNT (sizeof(fuseOps) / sizeof(fuseOps[0]))
+
+/* the fusion starting at pc, or -1 */
+static int Z80fusion(uint32 pc) {
+	uint32 i, n;
+
+	for (i = 0; i < FUSE_COUNT; ++i) {
+		for (n = 0; n < fuseOps[i][0] && GET_BYTE(pc + n) == fuseOps[i][n + 1]; ++n)
+			;
+		if (n == fuseOps[i][0])
+			return i;
+	}
+	return -1;
+}
+#endif
+
+/* decode the code at pc into block b, stopping after jumps, calls, returns and I/O */
+static void Z80blockDecode(block_t* b, uint32 pc, const void* const* opTable,
+	const void* const* ddTable, const void* const* edTable, const void* const* fdTable,
+	const void* const* fuseTable) {
+	const void* const* t;
+	uop_t* u;
+	uint32 len, line;
+	uint8 op, x, stop = FALSE;
+#ifdef Z80_FUSION
+	int f;
+	uint32 n;
+#endif
+
+	b->start = pc;
+	for (u = b->uop; !stop && u < b->uop + BLOCK_UOPS; ++u, pc += len) {
+		op = GET_BYTE(pc);
+		x = GET_BYTE(pc + 1);
+		switch (op) {
+		case 0xdd:
+		case 0xfd:
+			t = op == 0xdd ? ddTable : fdTable;
+			u->handler = t[x];
+			u->skip = 2;
+			if (t[x] == t[0x00])	/* not an IX/IY instruction (DD/FD 00 never is), the prefix is skipped alone */
+				len = 1;
+			else
+				len = 1 + Z80oplen(x) + Z80hasdisp(x);
+			UOP_CYCLES(cyclesXXTable, x);
+			UOP_FLAGS(1);
+			stop = x == 0xe9;
+			break;
+		case 0xed:
+			u->handler = edTable[x];
+			u->skip = 2;
+			len = (x & 0xc7) == 0x43 ? 4 : 2;
+			UOP_CYCLES(cyclesEDTable, x);
+			UOP_FLAGS(1);
+			stop = x == 0x45 || x == 0x4d || (x & 0xc6) == 0x40 || (x & 0xe6) == 0xa2;
+			break;
+		default:
+			u->handler = opTable[op];
+			u->skip = 1;
+			len = Z80oplen(op);
+			UOP_CYCLES(cyclesTable, op);
+			UOP_FLAGS(flagsUsedTable[op]);
+			stop = op == 0x18 || op == 0x76 || op == 0xc3 || op == 0xc9 || op == 0xcd ||
+				op == 0xd3 || op == 0xdb || op == 0xe9 || (op & 0xc7) == 0xc7;
+#ifdef Z80_FUSION
+			if ((f = Z80fusion(pc)) >= 0) {
+				n = fuseOps[f][0];
+				u->handler = fuseTable[f];
+				len = n - 1 + Z80oplen(fuseOps[f][n]);
+			}
+#endif
+		}
+		if (pc + len > 0x10000)	/* do not wrap around */
+			break;
+		u->pc = pc;
+	}
+	u->pc = BLOCK_END;
+	b->end = pc;
+	for (line = b->start >> 3; line < (b->end + 7) >> 3; ++line)
+		blockMap[line >> 3] |= 1 << (line & 7);
+}
+#endif
+
+/*	Register file
+
+	While Z80run() runs, the most used registers live in its local struct regs (their
+	names are redefined to its fields), which the compiler can keep in CPU registers
+	instead of loading and storing the globals on every instruction. The globals are
+	brought up to date before anything outside the core could look at them (I/O, which
+	includes the BIOS/BDOS traps and Lua, the debugger and the return from Z80run())
+	and read back afterwards.
+*/
+typedef struct {
+	int32 af, bc, de, hl, ix, iy, pc, sp, ir, pcx;
+	uint32 m1;		/* M1 cycles not added to R yet */
+} regs_t;
+
+static inline void Z80spill(const regs_t* r) {
+	AF = r->af;
+	BC = r->bc;
+	DE = r->de;
+	HL = r->hl;
+	IX = r->ix;
+	IY = r->iy;
+	PC = r->pc;
+	SP = r->sp;
+	IR = (r->ir & ~0x3f) | ((r->ir + r->m1) & 0x3f);
+	PCX = r->pcx;
+#ifdef DO_INCR
+	M1count += r->m1;
+#endif
+}
+
+static inline void Z80fill(regs_t* r) {
+	r->af = AF;
+	r->bc = BC;
+	r->de = DE;
+	r->hl = HL;
+	r->ix = IX;
+	r->iy = IY;
+	r->pc = PC;
+	r->sp = SP;
+	r->ir = IR;
+	r->pcx = PCX;
+	r->m1 = 0;
+}
+
+static inline uint32 Z80in(regs_t* r, const uint32 Port) {
+	uint32 Result;
+
+	Z80spill(r);
+	Result = cpu_in(Port);
+	Z80fill(r);
+	return(Result);
+}
+
+static inline void Z80out(regs_t* r, const uint32 Port, const uint32 Value) {
+	Z80spill(r);
+	cpu_out(Port, Value);
+	Z80fill(r);
+}
+
+static SRAM_FUNC void Z80run(void) {
 	uint32 temp = 0;
 	uint32 acu;
 	uint32 sum;
 	uint32 cbits;
 	uint32 op;
 	uint32 adr;
+	regs_t regs;
+#ifdef LAZY_FLAGS
+	uint32 lazy = 0;	/* kind of the instruction F is still to be worked out for */
+	uint32 lazyAcu = 0, lazyTemp = 0;	/* its operands */
+#endif
+#ifdef Z80_BLOCKS
+	const uop_t* uop = &blockNone;
+	block_t* blk;
+#endif
+
+	Z80fill(&regs);
+#define AF   regs.af
+#define BC   regs.bc
+#define DE   regs.de
+#define HL   regs.hl
+#define IX   regs.ix
+#define IY   regs.iy
+#define PC   regs.pc
+#define SP   regs.sp
+#define IR   regs.ir
+#define PCX  regs.pcx
+#define M1   regs.m1
+
+#ifdef Z80_THREADED
+	static const void* const opTable[256] SRAM_DATA = {
+		&&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+		&&op_0x08, &&op_0x09, &&op_0x0a, &&op_0x0b, &&op_0x0c, &&op_0x0d, &&op_0x0e, &&op_0x0f,
+		&&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+		&&op_0x18, &&op_0x19, &&op_0x1a, &&op_0x1b, &&op_0x1c, &&op_0x1d, &&op_0x1e, &&op_0x1f,
+		&&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+		&&op_0x28, &&op_0x29, &&op_0x2a, &&op_0x2b, &&op_0x2c, &&op_0x2d, &&op_0x2e, &&op_0x2f,
+		&&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+		&&op_0x38, &&op_0x39, &&op_0x3a, &&op_0x3b, &&op_0x3c, &&op_0x3d, &&op_0x3e, &&op_0x3f,
+		&&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+		&&op_0x48, &&op_0x49, &&op_0x4a, &&op_0x4b, &&op_0x4c, &&op_0x4d, &&op_0x4e, &&op_0x4f,
+		&&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+		&&op_0x58, &&op_0x59, &&op_0x5a, &&op_0x5b, &&op_0x5c, &&op_0x5d, &&op_0x5e, &&op_0x5f,
+		&&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+		&&op_0x68, &&op_0x69, &&op_0x6a, &&op_0x6b, &&op_0x6c, &&op_0x6d, &&op_0x6e, &&op_0x6f,
+		&&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+		&&op_0x78, &&op_0x79, &&op_0x7a, &&op_0x7b, &&op_0x7c, &&op_0x7d, &&op_0x7e, &&op_0x7f,
+		&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+		&&op_0x88, &&op_0x89, &&op_0x8a, &&op_0x8b, &&op_0x8c, &&op_0x8d, &&op_0x8e, &&op_0x8f,
+		&&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+		&&op_0x98, &&op_0x99, &&op_0x9a, &&op_0x9b, &&op_0x9c, &&op_0x9d, &&op_0x9e, &&op_0x9f,
+		&&op_0xa0, &&op_0xa1, &&op_0xa2, &&op_0xa3, &&op_0xa4, &&op_0xa5, &&op_0xa6, &&op_0xa7,
+		&&op_0xa8, &&op_0xa9, &&op_0xaa, &&op_0xab, &&op_0xac, &&op_0xad, &&op_0xae, &&op_0xaf,
+		&&op_0xb0, &&op_0xb1, &&op_0xb2, &&op_0xb3, &&op_0xb4, &&op_0xb5, &&op_0xb6, &&op_0xb7,
+		&&op_0xb8, &&op_0xb9, &&op_0xba, &&op_0xbb, &&op_0xbc, &&op_0xbd, &&op_0xbe, &&op_0xbf,
+		&&op_0xc0, &&op_0xc1, &&op_0xc2, &&op_0xc3, &&op_0xc4, &&op_0xc5, &&op_0xc6, &&op_0xc7,
+		&&op_0xc8, &&op_0xc9, &&op_0xca, &&op_0xcb, &&op_0xcc, &&op_0xcd, &&op_0xce, &&op_0xcf,
+		&&op_0xd0, &&op_0xd1, &&op_0xd2, &&op_0xd3, &&op_0xd4, &&op_0xd5, &&op_0xd6, &&op_0xd7,
+		&&op_0xd8, &&op_0xd9, &&op_0xda, &&op_0xdb, &&op_0xdc, &&op_0xdd, &&op_0xde, &&op_0xdf,
+		&&op_0xe0, &&op_0xe1, &&op_0xe2, &&op_0xe3, &&op_0xe4, &&op_0xe5, &&op_0xe6, &&op_0xe7,
+		&&op_0xe8, &&op_0xe9, &&op_0xea, &&op_0xeb, &&op_0xec, &&op_0xed, &&op_0xee, &&op_0xef,
+		&&op_0xf0, &&op_0xf1, &&op_0xf2, &&op_0xf3, &&op_0xf4, &&op_0xf5, &&op_0xf6, &&op_0xf7,
+		&&op_0xf8, &&op_0xf9, &&op_0xfa, &&op_0xfb, &&op_0xfc, &&op_0xfd, &&op_0xfe, &&op_0xff
+	};
+	/* the DD and FD prefixes run the same handlers (see cpu_xy.h) */
+#define XY_TABLE(p) { \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_0x09, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_0x19, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_0x21, &&p##_0x22, &&p##_0x23, &&p##_0x24, &&p##_0x25, &&p##_0x26, &&p##_default, \
+		&&p##_default, &&p##_0x29, &&p##_0x2a, &&p##_0x2b, &&p##_0x2c, &&p##_0x2d, &&p##_0x2e, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x34, &&p##_0x35, &&p##_0x36, &&p##_default, \
+		&&p##_default, &&p##_0x39, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x44, &&p##_0x45, &&p##_0x46, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x4c, &&p##_0x4d, &&p##_0x4e, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x54, &&p##_0x55, &&p##_0x56, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x5c, &&p##_0x5d, &&p##_0x5e, &&p##_default, \
+		&&p##_0x60, &&p##_0x61, &&p##_0x62, &&p##_0x63, &&p##_0x64, &&p##_0x65, &&p##_0x66, &&p##_0x67, \
+		&&p##_0x68, &&p##_0x69, &&p##_0x6a, &&p##_0x6b, &&p##_0x6c, &&p##_0x6d, &&p##_0x6e, &&p##_0x6f, \
+		&&p##_0x70, &&p##_0x71, &&p##_0x72, &&p##_0x73, &&p##_0x74, &&p##_0x75, &&p##_default, &&p##_0x77, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x7c, &&p##_0x7d, &&p##_0x7e, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x84, &&p##_0x85, &&p##_0x86, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x8c, &&p##_0x8d, &&p##_0x8e, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x94, &&p##_0x95, &&p##_0x96, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0x9c, &&p##_0x9d, &&p##_0x9e, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0xa4, &&p##_0xa5, &&p##_0xa6, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0xac, &&p##_0xad, &&p##_0xae, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0xb4, &&p##_0xb5, &&p##_0xb6, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_0xbc, &&p##_0xbd, &&p##_0xbe, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_0xcb, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_0xe1, &&p##_default, &&p##_0xe3, &&p##_default, &&p##_0xe5, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_0xe9, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, \
+		&&p##_default, &&p##_0xf9, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default, &&p##_default \
+	}
+	static const void* const ddTable[256] SRAM_DATA = XY_TABLE(dd);
+	static const void* const fdTable[256] SRAM_DATA = XY_TABLE(fd);
+#undef XY_TABLE
+	static const void* const edTable[256] SRAM_DATA = {
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_0x40, &&ed_0x41, &&ed_0x42, &&ed_0x43, &&ed_0x44, &&ed_0x45, &&ed_0x46, &&ed_0x47,
+		&&ed_0x48, &&ed_0x49, &&ed_0x4a, &&ed_0x4b, &&ed_0x4C, &&ed_0x4d, &&ed_default, &&ed_0x4f,
+		&&ed_0x50, &&ed_0x51, &&ed_0x52, &&ed_0x53, &&ed_0x54, &&ed_0x55, &&ed_0x56, &&ed_0x57,
+		&&ed_0x58, &&ed_0x59, &&ed_0x5a, &&ed_0x5b, &&ed_0x5C, &&ed_0x5D, &&ed_0x5e, &&ed_0x5f,
+		&&ed_0x60, &&ed_0x61, &&ed_0x62, &&ed_0x63, &&ed_0x64, &&ed_0x65, &&ed_default, &&ed_0x67,
+		&&ed_0x68, &&ed_0x69, &&ed_0x6a, &&ed_0x6b, &&ed_0x6C, &&ed_0x6D, &&ed_default, &&ed_0x6f,
+		&&ed_0x70, &&ed_0x71, &&ed_0x72, &&ed_0x73, &&ed_0x74, &&ed_0x75, &&ed_default, &&ed_default,
+		&&ed_0x78, &&ed_0x79, &&ed_0x7a, &&ed_0x7b, &&ed_0x7C, &&ed_0x7D, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_0xa0, &&ed_0xa1, &&ed_0xa2, &&ed_0xa3, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_0xa8, &&ed_0xa9, &&ed_0xaa, &&ed_0xab, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_0xb0, &&ed_0xb1, &&ed_0xb2, &&ed_0xb3, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_0xb8, &&ed_0xb9, &&ed_0xba, &&ed_0xbb, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default,
+		&&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default, &&ed_default
+	};
+#endif
+#ifdef Z80_FUSION
+#define FUSE2(a, b) &&fuse_##a##_##b,
+#define FUSE3(a, b, c) &&fuse_##a##_##b##_##c,
+	static const void* const fuseTable[FUSE_COUNT] = { FUSIONS };
+#undef FUSE2
+#undef FUSE3
+#elif defined(Z80_BLOCKS)
+	static const void* const* const fuseTable = NULL;
+#endif
+#ifdef Z80_BLOCKS
+	BLOCK_FLUSH;
+#endif
 
 	/* main instruction fetch/decode loop */
 	while (!Status) {	/* loop until Status != 0 */
 
 #ifdef DEBUG
-		if (PC == Break) {
-			_puts(":BREAK at ");
-			_puthex16(Break);
-			_puts(":");
-			Debug = 1;
-		}
-		if (PC == Step) {
-			Debug = 1;
-			Step = -1;
+		if (Debug | Armed) {
+			if ((Armed & ARM_BREAK) && BIT_TEST(BreakMap, PC & 0xffff)) {
+				_puts(":BREAK at ");
+				_puthex16(PC);
+				_puts(":");
+				Debug = 1;
+			}
+			if ((Armed & ARM_STEP) && PC == Step) {
+				Debug = 1;
+				Step = -1;
+				Z80arm();
+			}
+			if (Debug) {
+				FLAGS_NOW;
+				Z80spill(&regs);
+				Z80debug();
+				Z80fill(&regs);
+			}
 		}
-		if (Debug)
-			Z80debug();
 #endif
 
+		THROTTLE_CHECK;
 		PCX = PC;
 		INCR(1); /* Add one M1 cycle to refresh counter */
+		INSTR;
 
 #ifdef iDEBUG
-		iLogFile = fopen("iDump.log", "a");
-		switch (RAM[PCX & 0xffff]) {
-		case 0xCB: iLogTxt = MnemonicsCB[RAM[(PCX & 0xffff) + 1]]; break;
-		case 0xED: iLogTxt = MnemonicsED[RAM[(PCX & 0xffff) + 1]]; break;
-		case 0xDD:
-		case 0xFD:
-			if (RAM[PCX & 0xffff] == 0xCB) {
-				iLogTxt = MnemonicsXCB[RAM[(PCX & 0xffff) + 1]]; break;
-			} else {
-				iLogTxt = MnemonicsXX[RAM[(PCX & 0xffff) + 1]]; break;
-			}
-		default: iLogTxt = Mnemonics[RAM[PCX & 0xffff]];
-		}
-		sprintf(iLogBuffer, "0x%04x : 0x%02x = %s\n", PCX, RAM[PCX & 0xffff], iLogTxt);
-		fputs(iLogBuffer, iLogFile);
-		fclose(iLogFile);
+		Z80trace(PCX, AF, BC, DE, HL, SP);
 #endif
 
-		switch (RAM_PP(PC)) {
+		FLAGS_CHECK(flagsUsedTable[GET_BYTE(PC)]);
+		DISPATCH(op, FETCH(cyclesTable)) {
 
-		case 0x00:      /* NOP */
-			break;
+		OPCODE(op, 0x00)      /* NOP */
+			NEXT;
 
-		case 0x01:      /* LD BC,nnnn */
+		OPCODE(op, 0x01)      /* LD BC,nnnn */
 			BC = GET_WORD(PC);
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x02:      /* LD (BC),A */
+		OPCODE(op, 0x02)      /* LD (BC),A */
 			PUT_BYTE(BC, HIGH_REGISTER(AF));
-			break;
+			NEXT;
 
-		case 0x03:      /* INC BC */
+		OPCODE(op, 0x03)      /* INC BC */
 			++BC;
-			break;
+			NEXT;
 
-		case 0x04:      /* INC B */
+		OPCODE(op, 0x04)      /* INC B */
 			BC += 0x100;
 			temp = HIGH_REGISTER(BC);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x05:      /* DEC B */
+		OPCODE(op, 0x05)      /* DEC B */
 			BC -= 0x100;
 			temp = HIGH_REGISTER(BC);
 			AF = (AF & ~0xfe) | decTable[temp] | SET_PV2(0x7f); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x06:      /* LD B,nn */
+		OPCODE(op, 0x06)      /* LD B,nn */
 			SET_HIGH_REGISTER(BC, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x07:      /* RLCA */
+		OPCODE(op, 0x07)      /* RLCA */
 			AF = ((AF >> 7) & 0x0128) | ((AF << 1) & ~0x1ff) |
 				(AF & 0xc4) | ((AF >> 15) & 1);
-			break;
+			NEXT;
 
-		case 0x08:      /* EX AF,AF' */
+		OPCODE(op, 0x08)      /* EX AF,AF' */
 			temp = AF;
 			AF = AF1;
 			AF1 = temp;
-			break;
+			NEXT;
 
-		case 0x09:      /* ADD HL,BC */
+		OPCODE(op, 0x09)      /* ADD HL,BC */
 			HL &= ADDRMASK;
 			BC &= ADDRMASK;
 			sum = HL + BC;
 			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(HL ^ BC ^ sum) >> 8];
 			HL = sum;
-			break;
+			NEXT;
 
-		case 0x0a:      /* LD A,(BC) */
+		OPCODE(op, 0x0a)      /* LD A,(BC) */
 			SET_HIGH_REGISTER(AF, GET_BYTE(BC));
-			break;
+			NEXT;
 
-		case 0x0b:      /* DEC BC */
+		OPCODE(op, 0x0b)      /* DEC BC */
 			--BC;
-			break;
+			NEXT;
 
-		case 0x0c:      /* INC C */
+		OPCODE(op, 0x0c)      /* INC C */
 			temp = LOW_REGISTER(BC) + 1;
 			SET_LOW_REGISTER(BC, temp);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80);
-			break;
+			NEXT;
 
-		case 0x0d:      /* DEC C */
+		OPCODE(op, 0x0d)      /* DEC C */
 			temp = LOW_REGISTER(BC) - 1;
 			SET_LOW_REGISTER(BC, temp);
 			AF = (AF & ~0xfe) | decTable[temp & 0xff] | SET_PV2(0x7f);
-			break;
+			NEXT;
 
-		case 0x0e:      /* LD C,nn */
+		OPCODE(op, 0x0e)      /* LD C,nn */
 			SET_LOW_REGISTER(BC, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x0f:      /* RRCA */
+		OPCODE(op, 0x0f)      /* RRCA */
 			AF = (AF & 0xc4) | rrcaTable[HIGH_REGISTER(AF)];
-			break;
+			NEXT;
 
-		case 0x10:      /* DJNZ dd */
-			if ((BC -= 0x100) & 0xff00)
-				PC += (int8)GET_BYTE(PC) + 1;
-			else
-				++PC;
-			break;
+		OPCODE(op, 0x10)      /* DJNZ dd */
+			BC -= 0x100;
+			JRC(BC & 0xff00);
+			NEXT;
 
-		case 0x11:      /* LD DE,nnnn */
+		OPCODE(op, 0x11)      /* LD DE,nnnn */
 			DE = GET_WORD(PC);
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x12:      /* LD (DE),A */
+		OPCODE(op, 0x12)      /* LD (DE),A */
 			PUT_BYTE(DE, HIGH_REGISTER(AF));
-			break;
+			NEXT;
 
-		case 0x13:      /* INC DE */
+		OPCODE(op, 0x13)      /* INC DE */
 			++DE;
-			break;
+			NEXT;
 
-		case 0x14:      /* INC D */
+		OPCODE(op, 0x14)      /* INC D */
 			DE += 0x100;
 			temp = HIGH_REGISTER(DE);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x15:      /* DEC D */
+		OPCODE(op, 0x15)      /* DEC D */
 			DE -= 0x100;
 			temp = HIGH_REGISTER(DE);
 			AF = (AF & ~0xfe) | decTable[temp] | SET_PV2(0x7f); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x16:      /* LD D,nn */
+		OPCODE(op, 0x16)      /* LD D,nn */
 			SET_HIGH_REGISTER(DE, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x17:      /* RLA */
+		OPCODE(op, 0x17)      /* RLA */
 			AF = ((AF << 8) & 0x0100) | ((AF >> 7) & 0x28) | ((AF << 1) & ~0x01ff) |
 				(AF & 0xc4) | ((AF >> 15) & 1);
-			break;
+			NEXT;
 
-		case 0x18:      /* JR dd */
+		OPCODE(op, 0x18)      /* JR dd */
 			PC += (int8)GET_BYTE(PC) + 1;
-			break;
+			NEXT;
 
-		case 0x19:      /* ADD HL,DE */
+		OPCODE(op, 0x19)      /* ADD HL,DE */
 			HL &= ADDRMASK;
 			DE &= ADDRMASK;
 			sum = HL + DE;
 			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(HL ^ DE ^ sum) >> 8];
 			HL = sum;
-			break;
+			NEXT;
 
-		case 0x1a:      /* LD A,(DE) */
+		OPCODE(op, 0x1a)      /* LD A,(DE) */
 			SET_HIGH_REGISTER(AF, GET_BYTE(DE));
-			break;
+			NEXT;
 
-		case 0x1b:      /* DEC DE */
+		OPCODE(op, 0x1b)      /* DEC DE */
 			--DE;
-			break;
+			NEXT;
 
-		case 0x1c:      /* INC E */
+		OPCODE(op, 0x1c)      /* INC E */
 			temp = LOW_REGISTER(DE) + 1;
 			SET_LOW_REGISTER(DE, temp);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80);
-			break;
+			NEXT;
 
-		case 0x1d:      /* DEC E */
+		OPCODE(op, 0x1d)      /* DEC E */
 			temp = LOW_REGISTER(DE) - 1;
 			SET_LOW_REGISTER(DE, temp);
 			AF = (AF & ~0xfe) | decTable[temp & 0xff] | SET_PV2(0x7f);
-			break;
+			NEXT;
 
-		case 0x1e:      /* LD E,nn */
+		OPCODE(op, 0x1e)      /* LD E,nn */
 			SET_LOW_REGISTER(DE, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x1f:      /* RRA */
+		OPCODE(op, 0x1f)      /* RRA */
 			AF = ((AF & 1) << 15) | (AF & 0xc4) | rraTable[HIGH_REGISTER(AF)];
-			break;
+			NEXT;
 
-		case 0x20:      /* JR NZ,dd */
-			if (TSTFLAG(Z))
-				++PC;
-			else
-				PC += (int8)GET_BYTE(PC) + 1;
-			break;
+		OPCODE(op, 0x20)      /* JR NZ,dd */
+			JRC(!TSTFLAG(Z));
+			NEXT;
 
-		case 0x21:      /* LD HL,nnnn */
+		OPCODE(op, 0x21)      /* LD HL,nnnn */
 			HL = GET_WORD(PC);
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x22:      /* LD (nnnn),HL */
+		OPCODE(op, 0x22)      /* LD (nnnn),HL */
 			PUT_WORD(GET_WORD(PC), HL);
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x23:      /* INC HL */
+		OPCODE(op, 0x23)      /* INC HL */
 			++HL;
-			break;
+			NEXT;
 
-		case 0x24:      /* INC H */
+		OPCODE(op, 0x24)      /* INC H */
 			HL += 0x100;
 			temp = HIGH_REGISTER(HL);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x25:      /* DEC H */
+		OPCODE(op, 0x25)      /* DEC H */
 			HL -= 0x100;
 			temp = HIGH_REGISTER(HL);
 			AF = (AF & ~0xfe) | decTable[temp] | SET_PV2(0x7f); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x26:      /* LD H,nn */
+		OPCODE(op, 0x26)      /* LD H,nn */
 			SET_HIGH_REGISTER(HL, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x27:      /* DAA */
+		OPCODE(op, 0x27)      /* DAA */
 			acu = HIGH_REGISTER(AF);
 			temp = LOW_DIGIT(acu);
 			cbits = TSTFLAG(C);
@@ -1735,347 +2784,344 @@ static inline void Z80run(void) {
 					acu += 0x60;   /* adjust high digit */
 			}
 			AF = (AF & 0x12) | rrdrldTable[acu & 0xff] | ((acu >> 8) & 1) | cbits;
-			break;
+			NEXT;
 
-		case 0x28:      /* JR Z,dd */
-			if (TSTFLAG(Z))
-				PC += (int8)GET_BYTE(PC) + 1;
-			else
-				++PC;
-			break;
+		OPCODE(op, 0x28)      /* JR Z,dd */
+			JRC(TSTFLAG(Z));
+			NEXT;
 
-		case 0x29:      /* ADD HL,HL */
+		OPCODE(op, 0x29)      /* ADD HL,HL */
 			HL &= ADDRMASK;
 			sum = HL + HL;
 			AF = (AF & ~0x3b) | cbitsDup16Table[sum >> 8];
 			HL = sum;
-			break;
+			NEXT;
 
-		case 0x2a:      /* LD HL,(nnnn) */
+		OPCODE(op, 0x2a)      /* LD HL,(nnnn) */
 			HL = GET_WORD(GET_WORD(PC));
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x2b:      /* DEC HL */
+		OPCODE(op, 0x2b)      /* DEC HL */
 			--HL;
-			break;
+			NEXT;
 
-		case 0x2c:      /* INC L */
+		OPCODE(op, 0x2c)      /* INC L */
 			temp = LOW_REGISTER(HL) + 1;
 			SET_LOW_REGISTER(HL, temp);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80);
-			break;
+			NEXT;
 
-		case 0x2d:      /* DEC L */
+		OPCODE(op, 0x2d)      /* DEC L */
 			temp = LOW_REGISTER(HL) - 1;
 			SET_LOW_REGISTER(HL, temp);
 			AF = (AF & ~0xfe) | decTable[temp & 0xff] | SET_PV2(0x7f);
-			break;
+			NEXT;
 
-		case 0x2e:      /* LD L,nn */
+		OPCODE(op, 0x2e)      /* LD L,nn */
 			SET_LOW_REGISTER(HL, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x2f:      /* CPL */
+		OPCODE(op, 0x2f)      /* CPL */
 			AF = (~AF & ~0xff) | (AF & 0xc5) | ((~AF >> 8) & 0x28) | 0x12;
-			break;
+			NEXT;
 
-		case 0x30:      /* JR NC,dd */
-			if (TSTFLAG(C))
-				++PC;
-			else
-				PC += (int8)GET_BYTE(PC) + 1;
-			break;
+		OPCODE(op, 0x30)      /* JR NC,dd */
+			JRC(!TSTFLAG(C));
+			NEXT;
 
-		case 0x31:      /* LD SP,nnnn */
+		OPCODE(op, 0x31)      /* LD SP,nnnn */
 			SP = GET_WORD(PC);
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x32:      /* LD (nnnn),A */
+		OPCODE(op, 0x32)      /* LD (nnnn),A */
 			PUT_BYTE(GET_WORD(PC), HIGH_REGISTER(AF));
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x33:      /* INC SP */
+		OPCODE(op, 0x33)      /* INC SP */
 			++SP;
-			break;
+			NEXT;
 
-		case 0x34:      /* INC (HL) */
+		OPCODE(op, 0x34)      /* INC (HL) */
 			temp = GET_BYTE(HL) + 1;
 			PUT_BYTE(HL, temp);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80);
-			break;
+			NEXT;
 
-		case 0x35:      /* DEC (HL) */
+		OPCODE(op, 0x35)      /* DEC (HL) */
 			temp = GET_BYTE(HL) - 1;
 			PUT_BYTE(HL, temp);
 			AF = (AF & ~0xfe) | decTable[temp & 0xff] | SET_PV2(0x7f);
-			break;
+			NEXT;
 
-		case 0x36:      /* LD (HL),nn */
+		OPCODE(op, 0x36)      /* LD (HL),nn */
 			PUT_BYTE(HL, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x37:      /* SCF */
+		OPCODE(op, 0x37)      /* SCF */
 			AF = (AF & ~0x3b) | ((AF >> 8) & 0x28) | 1;
-			break;
+			NEXT;
 
-		case 0x38:      /* JR C,dd */
-			if (TSTFLAG(C))
-				PC += (int8)GET_BYTE(PC) + 1;
-			else
-				++PC;
-			break;
+		OPCODE(op, 0x38)      /* JR C,dd */
+			JRC(TSTFLAG(C));
+			NEXT;
 
-		case 0x39:      /* ADD HL,SP */
+		OPCODE(op, 0x39)      /* ADD HL,SP */
 			HL &= ADDRMASK;
 			SP &= ADDRMASK;
 			sum = HL + SP;
 			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(HL ^ SP ^ sum) >> 8];
 			HL = sum;
-			break;
+			NEXT;
 
-		case 0x3a:      /* LD A,(nnnn) */
+		OPCODE(op, 0x3a)      /* LD A,(nnnn) */
 			SET_HIGH_REGISTER(AF, GET_BYTE(GET_WORD(PC)));
 			PC += 2;
-			break;
+			NEXT;
 
-		case 0x3b:      /* DEC SP */
+		OPCODE(op, 0x3b)      /* DEC SP */
 			--SP;
-			break;
+			NEXT;
 
-		case 0x3c:      /* INC A */
+		OPCODE(op, 0x3c)      /* INC A */
 			AF += 0x100;
 			temp = HIGH_REGISTER(AF);
 			AF = (AF & ~0xfe) | incTable[temp] | SET_PV2(0x80); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x3d:      /* DEC A */
+		OPCODE(op, 0x3d)      /* DEC A */
 			AF -= 0x100;
 			temp = HIGH_REGISTER(AF);
 			AF = (AF & ~0xfe) | decTable[temp] | SET_PV2(0x7f); /* SET_PV2 uses temp */
-			break;
+			NEXT;
 
-		case 0x3e:      /* LD A,nn */
+		OPCODE(op, 0x3e)      /* LD A,nn */
 			SET_HIGH_REGISTER(AF, RAM_PP(PC));
-			break;
+			NEXT;
 
-		case 0x3f:      /* CCF */
+		OPCODE(op, 0x3f)      /* CCF */
 			AF = (AF & ~0x3b) | ((AF >> 8) & 0x28) | ((AF & 1) << 4) | (~AF & 1);
-			break;
+			NEXT;
 
-		case 0x40:      /* LD B,B */
-			break;
+		OPCODE(op, 0x40)      /* LD B,B */
+			NEXT;
 
-		case 0x41:      /* LD B,C */
+		OPCODE(op, 0x41)      /* LD B,C */
 			BC = (BC & 0xff) | ((BC & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x42:      /* LD B,D */
+		OPCODE(op, 0x42)      /* LD B,D */
 			BC = (BC & 0xff) | (DE & ~0xff);
-			break;
+			NEXT;
 
-		case 0x43:      /* LD B,E */
+		OPCODE(op, 0x43)      /* LD B,E */
 			BC = (BC & 0xff) | ((DE & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x44:      /* LD B,H */
+		OPCODE(op, 0x44)      /* LD B,H */
 			BC = (BC & 0xff) | (HL & ~0xff);
-			break;
+			NEXT;
 
-		case 0x45:      /* LD B,L */
+		OPCODE(op, 0x45)      /* LD B,L */
 			BC = (BC & 0xff) | ((HL & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x46:      /* LD B,(HL) */
+		OPCODE(op, 0x46)      /* LD B,(HL) */
 			SET_HIGH_REGISTER(BC, GET_BYTE(HL));
-			break;
+			NEXT;
 
-		case 0x47:      /* LD B,A */
+		OPCODE(op, 0x47)      /* LD B,A */
 			BC = (BC & 0xff) | (AF & ~0xff);
-			break;
+			NEXT;
 
-		case 0x48:      /* LD C,B */
+		OPCODE(op, 0x48)      /* LD C,B */
 			BC = (BC & ~0xff) | ((BC >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x49:      /* LD C,C */
-			break;
+		OPCODE(op, 0x49)      /* LD C,C */
+			NEXT;
 
-		case 0x4a:      /* LD C,D */
+		OPCODE(op, 0x4a)      /* LD C,D */
 			BC = (BC & ~0xff) | ((DE >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x4b:      /* LD C,E */
+		OPCODE(op, 0x4b)      /* LD C,E */
 			BC = (BC & ~0xff) | (DE & 0xff);
-			break;
+			NEXT;
 
-		case 0x4c:      /* LD C,H */
+		OPCODE(op, 0x4c)      /* LD C,H */
 			BC = (BC & ~0xff) | ((HL >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x4d:      /* LD C,L */
+		OPCODE(op, 0x4d)      /* LD C,L */
 			BC = (BC & ~0xff) | (HL & 0xff);
-			break;
+			NEXT;
 
-		case 0x4e:      /* LD C,(HL) */
+		OPCODE(op, 0x4e)      /* LD C,(HL) */
 			SET_LOW_REGISTER(BC, GET_BYTE(HL));
-			break;
+			NEXT;
 
-		case 0x4f:      /* LD C,A */
+		OPCODE(op, 0x4f)      /* LD C,A */
 			BC = (BC & ~0xff) | ((AF >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x50:      /* LD D,B */
+		OPCODE(op, 0x50)      /* LD D,B */
 			DE = (DE & 0xff) | (BC & ~0xff);
-			break;
+			NEXT;
 
-		case 0x51:      /* LD D,C */
+		OPCODE(op, 0x51)      /* LD D,C */
 			DE = (DE & 0xff) | ((BC & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x52:      /* LD D,D */
-			break;
+		OPCODE(op, 0x52)      /* LD D,D */
+			NEXT;
 
-		case 0x53:      /* LD D,E */
+		OPCODE(op, 0x53)      /* LD D,E */
 			DE = (DE & 0xff) | ((DE & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x54:      /* LD D,H */
+		OPCODE(op, 0x54)      /* LD D,H */
 			DE = (DE & 0xff) | (HL & ~0xff);
-			break;
+			NEXT;
 
-		case 0x55:      /* LD D,L */
+		OPCODE(op, 0x55)      /* LD D,L */
 			DE = (DE & 0xff) | ((HL & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x56:      /* LD D,(HL) */
+		OPCODE(op, 0x56)      /* LD D,(HL) */
 			SET_HIGH_REGISTER(DE, GET_BYTE(HL));
-			break;
+			NEXT;
 
-		case 0x57:      /* LD D,A */
+		OPCODE(op, 0x57)      /* LD D,A */
 			DE = (DE & 0xff) | (AF & ~0xff);
-			break;
+			NEXT;
 
-		case 0x58:      /* LD E,B */
+		OPCODE(op, 0x58)      /* LD E,B */
 			DE = (DE & ~0xff) | ((BC >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x59:      /* LD E,C */
+		OPCODE(op, 0x59)      /* LD E,C */
 			DE = (DE & ~0xff) | (BC & 0xff);
-			break;
+			NEXT;
 
-		case 0x5a:      /* LD E,D */
+		OPCODE(op, 0x5a)      /* LD E,D */
 			DE = (DE & ~0xff) | ((DE >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x5b:      /* LD E,E */
-			break;
+		OPCODE(op, 0x5b)      /* LD E,E */
+			NEXT;
 
-		case 0x5c:      /* LD E,H */
+		OPCODE(op, 0x5c)      /* LD E,H */
 			DE = (DE & ~0xff) | ((HL >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x5d:      /* LD E,L */
+		OPCODE(op, 0x5d)      /* LD E,L */
 			DE = (DE & ~0xff) | (HL & 0xff);
-			break;
+			NEXT;
 
-		case 0x5e:      /* LD E,(HL) */
+		OPCODE(op, 0x5e)      /* LD E,(HL) */
 			SET_LOW_REGISTER(DE, GET_BYTE(HL));
-			break;
+			NEXT;
 
-		case 0x5f:      /* LD E,A */
+		OPCODE(op, 0x5f)      /* LD E,A */
 			DE = (DE & ~0xff) | ((AF >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x60:      /* LD H,B */
+		OPCODE(op, 0x60)      /* LD H,B */
 			HL = (HL & 0xff) | (BC & ~0xff);
-			break;
+			NEXT;
 
-		case 0x61:      /* LD H,C */
+		OPCODE(op, 0x61)      /* LD H,C */
 			HL = (HL & 0xff) | ((BC & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x62:      /* LD H,D */
+		OPCODE(op, 0x62)      /* LD H,D */
 			HL = (HL & 0xff) | (DE & ~0xff);
-			break;
+			NEXT;
 
-		case 0x63:      /* LD H,E */
+		OPCODE(op, 0x63)      /* LD H,E */
 			HL = (HL & 0xff) | ((DE & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x64:      /* LD H,H */
-			break;
+		OPCODE(op, 0x64)      /* LD H,H */
+			NEXT;
 
-		case 0x65:      /* LD H,L */
+		OPCODE(op, 0x65)      /* LD H,L */
 			HL = (HL & 0xff) | ((HL & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x66:      /* LD H,(HL) */
+		OPCODE(op, 0x66)      /* LD H,(HL) */
 			SET_HIGH_REGISTER(HL, GET_BYTE(HL));
-			break;
+			NEXT;
 
-		case 0x67:      /* LD H,A */
+		OPCODE(op, 0x67)      /* LD H,A */
 			HL = (HL & 0xff) | (AF & ~0xff);
-			break;
+			NEXT;
 
-		case 0x68:      /* LD L,B */
+		OPCODE(op, 0x68)      /* LD L,B */
 			HL = (HL & ~0xff) | ((BC >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x69:      /* LD L,C */
+		OPCODE(op, 0x69)      /* LD L,C */
 			HL = (HL & ~0xff) | (BC & 0xff);
-			break;
+			NEXT;
 
-		case 0x6a:      /* LD L,D */
+		OPCODE(op, 0x6a)      /* LD L,D */
 			HL = (HL & ~0xff) | ((DE >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x6b:      /* LD L,E */
+		OPCODE(op, 0x6b)      /* LD L,E */
 			HL = (HL & ~0xff) | (DE & 0xff);
-			break;
+			NEXT;
 
-		case 0x6c:      /* LD L,H */
+		OPCODE(op, 0x6c)      /* LD L,H */
 			HL = (HL & ~0xff) | ((HL >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x6d:      /* LD L,L */
-			break;
+		OPCODE(op, 0x6d)      /* LD L,L */
+			NEXT;
 
-		case 0x6e:      /* LD L,(HL) */
+		OPCODE(op, 0x6e)      /* LD L,(HL) */
 			SET_LOW_REGISTER(HL, GET_BYTE(HL));
-			break;
+			NEXT;
 
-		case 0x6f:      /* LD L,A */
+		OPCODE(op, 0x6f)      /* LD L,A */
 			HL = (HL & ~0xff) | ((AF >> 8) & 0xff);
-			break;
+			NEXT;
 
-		case 0x70:      /* LD (HL),B */
+		OPCODE(op, 0x70)      /* LD (HL),B */
 			PUT_BYTE(HL, HIGH_REGISTER(BC));
-			break;
+			NEXT;
 
-		case 0x71:      /* LD (HL),C */
+		OPCODE(op, 0x71)      /* LD (HL),C */
 			PUT_BYTE(HL, LOW_REGISTER(BC));
-			break;
+			NEXT;
 
-		case 0x72:      /* LD (HL),D */
+		OPCODE(op, 0x72)      /* LD (HL),D */
 			PUT_BYTE(HL, HIGH_REGISTER(DE));
-			break;
+			NEXT;
 
-		case 0x73:      /* LD (HL),E */
+		OPCODE(op, 0x73)      /* LD (HL),E */
 			PUT_BYTE(HL, LOW_REGISTER(DE));
-			break;
+			NEXT;
 
-		case 0x74:      /* LD (HL),H */
+		OPCODE(op, 0x74)      /* LD (HL),H */
 			PUT_BYTE(HL, HIGH_REGISTER(HL));
-			break;
+			NEXT;
 
-		case 0x75:      /* LD (HL),L */
+		OPCODE(op, 0x75)      /* LD (HL),L */
 			PUT_BYTE(HL, LOW_REGISTER(HL));
-			break;
+			NEXT;
 
-		case 0x76:      /* HALT */
+		OPCODE(op, 0x76)      /* HALT */
+#ifdef HALT_WAIT
+			if (IFF & 1) {	/* something could still wake the CPU up */
+				Z80halt();
+				NEXT;
+			}
+#endif
 #ifdef DEBUG
 			_puts("\r\n::CPU HALTED::");	// A halt is a good indicator of broken code
 			_puts("Press any key...");
@@ -2083,508 +3129,499 @@ static inline void Z80run(void) {
 #endif
 			--PC;
 			goto end_decode;
-			break;
+			NEXT;
 
-		case 0x77:      /* LD (HL),A */
+		OPCODE(op, 0x77)      /* LD (HL),A */
 			PUT_BYTE(HL, HIGH_REGISTER(AF));
-			break;
+			NEXT;
 
-		case 0x78:      /* LD A,B */
+		OPCODE(op, 0x78)      /* LD A,B */
 			AF = (AF & 0xff) | (BC & ~0xff);
-			break;
+			NEXT;
 
-		case 0x79:      /* LD A,C */
+		OPCODE(op, 0x79)      /* LD A,C */
 			AF = (AF & 0xff) | ((BC & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x7a:      /* LD A,D */
+		OPCODE(op, 0x7a)      /* LD A,D */
 			AF = (AF & 0xff) | (DE & ~0xff);
-			break;
+			NEXT;
 
-		case 0x7b:      /* LD A,E */
+		OPCODE(op, 0x7b)      /* LD A,E */
 			AF = (AF & 0xff) | ((DE & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x7c:      /* LD A,H */
+		OPCODE(op, 0x7c)      /* LD A,H */
 			AF = (AF & 0xff) | (HL & ~0xff);
-			break;
+			NEXT;
 
-		case 0x7d:      /* LD A,L */
+		OPCODE(op, 0x7d)      /* LD A,L */
 			AF = (AF & 0xff) | ((HL & 0xff) << 8);
-			break;
+			NEXT;
 
-		case 0x7e:      /* LD A,(HL) */
+		OPCODE(op, 0x7e)      /* LD A,(HL) */
 			SET_HIGH_REGISTER(AF, GET_BYTE(HL));
-			break;
+			NEXT;
 
-		case 0x7f:      /* LD A,A */
-			break;
+		OPCODE(op, 0x7f)      /* LD A,A */
+			NEXT;
 
-		case 0x80:      /* ADD A,B */
+		OPCODE(op, 0x80)      /* ADD A,B */
 			temp = HIGH_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0x81:      /* ADD A,C */
+		OPCODE(op, 0x81)      /* ADD A,C */
 			temp = LOW_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0x82:      /* ADD A,D */
+		OPCODE(op, 0x82)      /* ADD A,D */
 			temp = HIGH_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0x83:      /* ADD A,E */
+		OPCODE(op, 0x83)      /* ADD A,E */
 			temp = LOW_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0x84:      /* ADD A,H */
+		OPCODE(op, 0x84)      /* ADD A,H */
 			temp = HIGH_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0x85:      /* ADD A,L */
+		OPCODE(op, 0x85)      /* ADD A,L */
 			temp = LOW_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0x86:      /* ADD A,(HL) */
+		OPCODE(op, 0x86)      /* ADD A,(HL) */
 			temp = GET_BYTE(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0x87:      /* ADD A,A */
+		OPCODE(op, 0x87)      /* ADD A,A */
 			cbits = 2 * HIGH_REGISTER(AF);
 			AF = cbitsDup8Table[cbits] | (SET_PVS(cbits));
-			break;
+			NEXT;
 
-		case 0x88:      /* ADC A,B */
+		OPCODE(op, 0x88)      /* ADC A,B */
 			temp = HIGH_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x89:      /* ADC A,C */
+		OPCODE(op, 0x89)      /* ADC A,C */
 			temp = LOW_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x8a:      /* ADC A,D */
+		OPCODE(op, 0x8a)      /* ADC A,D */
 			temp = HIGH_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x8b:      /* ADC A,E */
+		OPCODE(op, 0x8b)      /* ADC A,E */
 			temp = LOW_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x8c:      /* ADC A,H */
+		OPCODE(op, 0x8c)      /* ADC A,H */
 			temp = HIGH_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x8d:      /* ADC A,L */
+		OPCODE(op, 0x8d)      /* ADC A,L */
 			temp = LOW_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x8e:      /* ADC A,(HL) */
+		OPCODE(op, 0x8e)      /* ADC A,(HL) */
 			temp = GET_BYTE(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x8f:      /* ADC A,A */
+		OPCODE(op, 0x8f)      /* ADC A,A */
 			cbits = 2 * HIGH_REGISTER(AF) + TSTFLAG(C);
 			AF = cbitsDup8Table[cbits] | (SET_PVS(cbits));
-			break;
+			NEXT;
 
-		case 0x90:      /* SUB B */
+		OPCODE(op, 0x90)      /* SUB B */
 			temp = HIGH_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0x91:      /* SUB C */
+		OPCODE(op, 0x91)      /* SUB C */
 			temp = LOW_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0x92:      /* SUB D */
+		OPCODE(op, 0x92)      /* SUB D */
 			temp = HIGH_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0x93:      /* SUB E */
+		OPCODE(op, 0x93)      /* SUB E */
 			temp = LOW_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0x94:      /* SUB H */
+		OPCODE(op, 0x94)      /* SUB H */
 			temp = HIGH_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0x95:      /* SUB L */
+		OPCODE(op, 0x95)      /* SUB L */
 			temp = LOW_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0x96:      /* SUB (HL) */
+		OPCODE(op, 0x96)      /* SUB (HL) */
 			temp = GET_BYTE(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0x97:      /* SUB A */
+		OPCODE(op, 0x97)      /* SUB A */
 			AF = 0x42;
-			break;
+			NEXT;
 
-		case 0x98:      /* SBC A,B */
+		OPCODE(op, 0x98)      /* SBC A,B */
 			temp = HIGH_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x99:      /* SBC A,C */
+		OPCODE(op, 0x99)      /* SBC A,C */
 			temp = LOW_REGISTER(BC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x9a:      /* SBC A,D */
+		OPCODE(op, 0x9a)      /* SBC A,D */
 			temp = HIGH_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x9b:      /* SBC A,E */
+		OPCODE(op, 0x9b)      /* SBC A,E */
 			temp = LOW_REGISTER(DE);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x9c:      /* SBC A,H */
+		OPCODE(op, 0x9c)      /* SBC A,H */
 			temp = HIGH_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x9d:      /* SBC A,L */
+		OPCODE(op, 0x9d)      /* SBC A,L */
 			temp = LOW_REGISTER(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x9e:      /* SBC A,(HL) */
+		OPCODE(op, 0x9e)      /* SBC A,(HL) */
 			temp = GET_BYTE(HL);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0x9f:      /* SBC A,A */
+		OPCODE(op, 0x9f)      /* SBC A,A */
 			cbits = -TSTFLAG(C);
 			AF = subTable[cbits & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PVS(cbits));
-			break;
+			NEXT;
 
-		case 0xa0:      /* AND B */
+		OPCODE(op, 0xa0)      /* AND B */
 			AF = andTable[((AF & BC) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa1:      /* AND C */
+		OPCODE(op, 0xa1)      /* AND C */
 			AF = andTable[((AF >> 8)& BC) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa2:      /* AND D */
+		OPCODE(op, 0xa2)      /* AND D */
 			AF = andTable[((AF & DE) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa3:      /* AND E */
+		OPCODE(op, 0xa3)      /* AND E */
 			AF = andTable[((AF >> 8)& DE) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa4:      /* AND H */
+		OPCODE(op, 0xa4)      /* AND H */
 			AF = andTable[((AF & HL) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa5:      /* AND L */
+		OPCODE(op, 0xa5)      /* AND L */
 			AF = andTable[((AF >> 8)& HL) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa6:      /* AND (HL) */
+		OPCODE(op, 0xa6)      /* AND (HL) */
 			AF = andTable[((AF >> 8)& GET_BYTE(HL)) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa7:      /* AND A */
+		OPCODE(op, 0xa7)      /* AND A */
 			AF = andTable[(AF >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa8:      /* XOR B */
+		OPCODE(op, 0xa8)      /* XOR B */
 			AF = xororTable[((AF ^ BC) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xa9:      /* XOR C */
+		OPCODE(op, 0xa9)      /* XOR C */
 			AF = xororTable[((AF >> 8) ^ BC) & 0xff];
-			break;
+			NEXT;
 
-		case 0xaa:      /* XOR D */
+		OPCODE(op, 0xaa)      /* XOR D */
 			AF = xororTable[((AF ^ DE) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xab:      /* XOR E */
+		OPCODE(op, 0xab)      /* XOR E */
 			AF = xororTable[((AF >> 8) ^ DE) & 0xff];
-			break;
+			NEXT;
 
-		case 0xac:      /* XOR H */
+		OPCODE(op, 0xac)      /* XOR H */
 			AF = xororTable[((AF ^ HL) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xad:      /* XOR L */
+		OPCODE(op, 0xad)      /* XOR L */
 			AF = xororTable[((AF >> 8) ^ HL) & 0xff];
-			break;
+			NEXT;
 
-		case 0xae:      /* XOR (HL) */
+		OPCODE(op, 0xae)      /* XOR (HL) */
 			AF = xororTable[((AF >> 8) ^ GET_BYTE(HL)) & 0xff];
-			break;
+			NEXT;
 
-		case 0xaf:      /* XOR A */
+		OPCODE(op, 0xaf)      /* XOR A */
 			AF = 0x44;
-			break;
+			NEXT;
 
-		case 0xb0:      /* OR B */
+		OPCODE(op, 0xb0)      /* OR B */
 			AF = xororTable[((AF | BC) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb1:      /* OR C */
+		OPCODE(op, 0xb1)      /* OR C */
 			AF = xororTable[((AF >> 8) | BC) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb2:      /* OR D */
+		OPCODE(op, 0xb2)      /* OR D */
 			AF = xororTable[((AF | DE) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb3:      /* OR E */
+		OPCODE(op, 0xb3)      /* OR E */
 			AF = xororTable[((AF >> 8) | DE) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb4:      /* OR H */
+		OPCODE(op, 0xb4)      /* OR H */
 			AF = xororTable[((AF | HL) >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb5:      /* OR L */
+		OPCODE(op, 0xb5)      /* OR L */
 			AF = xororTable[((AF >> 8) | HL) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb6:      /* OR (HL) */
+		OPCODE(op, 0xb6)      /* OR (HL) */
 			AF = xororTable[((AF >> 8) | GET_BYTE(HL)) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb7:      /* OR A */
+		OPCODE(op, 0xb7)      /* OR A */
 			AF = xororTable[(AF >> 8) & 0xff];
-			break;
+			NEXT;
 
-		case 0xb8:      /* CP B */
+		OPCODE(op, 0xb8)      /* CP B */
 			temp = HIGH_REGISTER(BC);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xb9:      /* CP C */
+		OPCODE(op, 0xb9)      /* CP C */
 			temp = LOW_REGISTER(BC);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xba:      /* CP D */
+		OPCODE(op, 0xba)      /* CP D */
 			temp = HIGH_REGISTER(DE);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xbb:      /* CP E */
+		OPCODE(op, 0xbb)      /* CP E */
 			temp = LOW_REGISTER(DE);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xbc:      /* CP H */
+		OPCODE(op, 0xbc)      /* CP H */
 			temp = HIGH_REGISTER(HL);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xbd:      /* CP L */
+		OPCODE(op, 0xbd)      /* CP L */
 			temp = LOW_REGISTER(HL);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xbe:      /* CP (HL) */
+		OPCODE(op, 0xbe)      /* CP (HL) */
 			temp = GET_BYTE(HL);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xbf:      /* CP A */
+		OPCODE(op, 0xbf)      /* CP A */
 			SET_LOW_REGISTER(AF, (HIGH_REGISTER(AF) & 0x28) | 0x42);
-			break;
+			NEXT;
 
-		case 0xc0:      /* RET NZ */
-			if (!(TSTFLAG(Z)))
-				POP(PC);
-			break;
+		OPCODE(op, 0xc0)      /* RET NZ */
+			RETC(!TSTFLAG(Z));
+			NEXT;
 
-		case 0xc1:      /* POP BC */
+		OPCODE(op, 0xc1)      /* POP BC */
 			POP(BC);
-			break;
+			NEXT;
 
-		case 0xc2:      /* JP NZ,nnnn */
+		OPCODE(op, 0xc2)      /* JP NZ,nnnn */
 			JPC(!TSTFLAG(Z));
-			break;
+			NEXT;
 
-		case 0xc3:      /* JP nnnn */
+		OPCODE(op, 0xc3)      /* JP nnnn */
 			JPC(1);
-			break;
+			NEXT;
 
-		case 0xc4:      /* CALL NZ,nnnn */
+		OPCODE(op, 0xc4)      /* CALL NZ,nnnn */
 			CALLC(!TSTFLAG(Z));
-			break;
+			NEXT;
 
-		case 0xc5:      /* PUSH BC */
+		OPCODE(op, 0xc5)      /* PUSH BC */
 			PUSH(BC);
-			break;
+			NEXT;
 
-		case 0xc6:      /* ADD A,nn */
+		OPCODE(op, 0xc6)      /* ADD A,nn */
 			temp = RAM_PP(PC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			ADD_FLAGS;
+			NEXT;
 
-		case 0xc7:      /* RST 0 */
+		OPCODE(op, 0xc7)      /* RST 0 */
 			PUSH(PC);
 			PC = 0;
-			break;
+			NEXT;
 
-		case 0xc8:      /* RET Z */
-			if (TSTFLAG(Z))
-				POP(PC);
-			break;
+		OPCODE(op, 0xc8)      /* RET Z */
+			RETC(TSTFLAG(Z));
+			NEXT;
 
-		case 0xc9:      /* RET */
+		OPCODE(op, 0xc9)      /* RET */
 			POP(PC);
-			break;
+			NEXT;
 
-		case 0xca:      /* JP Z,nnnn */
+		OPCODE(op, 0xca)      /* JP Z,nnnn */
 			JPC(TSTFLAG(Z));
-			break;
+			NEXT;
 
-		case 0xcb:      /* CB prefix */
+		OPCODE(op, 0xcb)      /* CB prefix */
 			INCR(1); /* Add one M1 cycle to refresh counter */
 			adr = HL;
 			switch ((op = GET_BYTE(PC)) & 7) {
@@ -2629,6 +3666,7 @@ static inline void Z80run(void) {
 				acu = HIGH_REGISTER(AF);
 				break;
 			}
+			CYCLES(cyclesCBTable[op]);
 			switch (op & 0xc0) {
 
 			case 0x00:  /* shift/rotate */
@@ -2729,73 +3767,71 @@ static inline void Z80run(void) {
 				SET_HIGH_REGISTER(AF, temp);
 				break;
 			}
-			break;
+			NEXT;
 
-		case 0xcc:      /* CALL Z,nnnn */
+		OPCODE(op, 0xcc)      /* CALL Z,nnnn */
 			CALLC(TSTFLAG(Z));
-			break;
+			NEXT;
 
-		case 0xcd:      /* CALL nnnn */
+		OPCODE(op, 0xcd)      /* CALL nnnn */
 			CALLC(1);
-			break;
+			NEXT;
 
-		case 0xce:      /* ADC A,nn */
+		OPCODE(op, 0xce)      /* ADC A,nn */
 			temp = RAM_PP(PC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = addTable[sum] | cbitsTable[cbits] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0xcf:      /* RST 8 */
+		OPCODE(op, 0xcf)      /* RST 8 */
 			PUSH(PC);
 			PC = 8;
-			break;
+			NEXT;
 
-		case 0xd0:      /* RET NC */
-			if (!(TSTFLAG(C)))
-				POP(PC);
-			break;
+		OPCODE(op, 0xd0)      /* RET NC */
+			RETC(!TSTFLAG(C));
+			NEXT;
 
-		case 0xd1:      /* POP DE */
+		OPCODE(op, 0xd1)      /* POP DE */
 			POP(DE);
-			break;
+			NEXT;
 
-		case 0xd2:      /* JP NC,nnnn */
+		OPCODE(op, 0xd2)      /* JP NC,nnnn */
 			JPC(!TSTFLAG(C));
-			break;
+			NEXT;
 
-		case 0xd3:      /* OUT (nn),A */
-			cpu_out(RAM_PP(PC), HIGH_REGISTER(AF));
-			break;
+		OPCODE(op, 0xd3)      /* OUT (nn),A */
+			Z80out(&regs, RAM_PP(PC), HIGH_REGISTER(AF));
+			NEXT;
 
-		case 0xd4:      /* CALL NC,nnnn */
+		OPCODE(op, 0xd4)      /* CALL NC,nnnn */
 			CALLC(!TSTFLAG(C));
-			break;
+			NEXT;
 
-		case 0xd5:      /* PUSH DE */
+		OPCODE(op, 0xd5)      /* PUSH DE */
 			PUSH(DE);
-			break;
+			NEXT;
 
-		case 0xd6:      /* SUB nn */
+		OPCODE(op, 0xd6)      /* SUB nn */
 			temp = RAM_PP(PC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			SUB_FLAGS;
+			NEXT;
 
-		case 0xd7:      /* RST 10H */
+		OPCODE(op, 0xd7)      /* RST 10H */
 			PUSH(PC);
 			PC = 0x10;
-			break;
+			NEXT;
 
-		case 0xd8:      /* RET C */
-			if (TSTFLAG(C))
-				POP(PC);
-			break;
+		OPCODE(op, 0xd8)      /* RET C */
+			RETC(TSTFLAG(C));
+			NEXT;
 
-		case 0xd9:      /* EXX */
+		OPCODE(op, 0xd9)      /* EXX */
 			temp = BC;
 			BC = BC1;
 			BC1 = temp;
@@ -2805,681 +3841,111 @@ static inline void Z80run(void) {
 			temp = HL;
 			HL = HL1;
 			HL1 = temp;
-			break;
+			NEXT;
 
-		case 0xda:      /* JP C,nnnn */
+		OPCODE(op, 0xda)      /* JP C,nnnn */
 			JPC(TSTFLAG(C));
-			break;
+			NEXT;
 
-		case 0xdb:      /* IN A,(nn) */
-			SET_HIGH_REGISTER(AF, cpu_in(RAM_PP(PC)));
-			break;
+		OPCODE(op, 0xdb)      /* IN A,(nn) */
+			SET_HIGH_REGISTER(AF, Z80in(&regs, RAM_PP(PC)));
+			NEXT;
 
-		case 0xdc:      /* CALL C,nnnn */
+		OPCODE(op, 0xdc)      /* CALL C,nnnn */
 			CALLC(TSTFLAG(C));
-			break;
+			NEXT;
 
-		case 0xdd:      /* DD prefix */
-			INCR(1); /* Add one M1 cycle to refresh counter */
-			switch (RAM_PP(PC)) {
+		OPCODE(op, 0xdd)      /* DD prefix */
+#define IXY IX
+#define XY_PREFIX dd
+#define XY_CBSHFLG cbshflg2
+#include "cpu_xy.h"
 
-			case 0x09:      /* ADD IX,BC */
-				IX &= ADDRMASK;
-				BC &= ADDRMASK;
-				sum = IX + BC;
-				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IX ^ BC ^ sum) >> 8];
-				IX = sum;
-				break;
-
-			case 0x19:      /* ADD IX,DE */
-				IX &= ADDRMASK;
-				DE &= ADDRMASK;
-				sum = IX + DE;
-				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IX ^ DE ^ sum) >> 8];
-				IX = sum;
-				break;
-
-			case 0x21:      /* LD IX,nnnn */
-				IX = GET_WORD(PC);
-				PC += 2;
-				break;
-
-			case 0x22:      /* LD (nnnn),IX */
-				PUT_WORD(GET_WORD(PC), IX);
-				PC += 2;
-				break;
-
-			case 0x23:      /* INC IX */
-				++IX;
-				break;
-
-			case 0x24:      /* INC IXH */
-				IX += 0x100;
-				AF = (AF & ~0xfe) | incZ80Table[HIGH_REGISTER(IX)];
-				break;
-
-			case 0x25:      /* DEC IXH */
-				IX -= 0x100;
-				AF = (AF & ~0xfe) | decZ80Table[HIGH_REGISTER(IX)];
-				break;
-
-			case 0x26:      /* LD IXH,nn */
-				SET_HIGH_REGISTER(IX, RAM_PP(PC));
-				break;
-
-			case 0x29:      /* ADD IX,IX */
-				IX &= ADDRMASK;
-				sum = IX + IX;
-				AF = (AF & ~0x3b) | cbitsDup16Table[sum >> 8];
-				IX = sum;
-				break;
-
-			case 0x2a:      /* LD IX,(nnnn) */
-				IX = GET_WORD(GET_WORD(PC));
-				PC += 2;
-				break;
-
-			case 0x2b:      /* DEC IX */
-				--IX;
-				break;
-
-			case 0x2c:      /* INC IXL */
-				temp = LOW_REGISTER(IX) + 1;
-				SET_LOW_REGISTER(IX, temp);
-				AF = (AF & ~0xfe) | incZ80Table[temp];
-				break;
-
-			case 0x2d:      /* DEC IXL */
-				temp = LOW_REGISTER(IX) - 1;
-				SET_LOW_REGISTER(IX, temp);
-				AF = (AF & ~0xfe) | decZ80Table[temp & 0xff];
-				break;
-
-			case 0x2e:      /* LD IXL,nn */
-				SET_LOW_REGISTER(IX, RAM_PP(PC));
-				break;
-
-			case 0x34:      /* INC (IX+dd) */
-				adr = IX + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr) + 1;
-				PUT_BYTE(adr, temp);
-				AF = (AF & ~0xfe) | incZ80Table[temp];
-				break;
-
-			case 0x35:      /* DEC (IX+dd) */
-				adr = IX + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr) - 1;
-				PUT_BYTE(adr, temp);
-				AF = (AF & ~0xfe) | decZ80Table[temp & 0xff];
-				break;
-
-			case 0x36:      /* LD (IX+dd),nn */
-				adr = IX + (int8)RAM_PP(PC);
-				PUT_BYTE(adr, RAM_PP(PC));
-				break;
-
-			case 0x39:      /* ADD IX,SP */
-				IX &= ADDRMASK;
-				SP &= ADDRMASK;
-				sum = IX + SP;
-				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IX ^ SP ^ sum) >> 8];
-				IX = sum;
-				break;
-
-			case 0x44:      /* LD B,IXH */
-				SET_HIGH_REGISTER(BC, HIGH_REGISTER(IX));
-				break;
-
-			case 0x45:      /* LD B,IXL */
-				SET_HIGH_REGISTER(BC, LOW_REGISTER(IX));
-				break;
-
-			case 0x46:      /* LD B,(IX+dd) */
-				SET_HIGH_REGISTER(BC, GET_BYTE(IX + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x4c:      /* LD C,IXH */
-				SET_LOW_REGISTER(BC, HIGH_REGISTER(IX));
-				break;
-
-			case 0x4d:      /* LD C,IXL */
-				SET_LOW_REGISTER(BC, LOW_REGISTER(IX));
-				break;
-
-			case 0x4e:      /* LD C,(IX+dd) */
-				SET_LOW_REGISTER(BC, GET_BYTE(IX + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x54:      /* LD D,IXH */
-				SET_HIGH_REGISTER(DE, HIGH_REGISTER(IX));
-				break;
-
-			case 0x55:      /* LD D,IXL */
-				SET_HIGH_REGISTER(DE, LOW_REGISTER(IX));
-				break;
-
-			case 0x56:      /* LD D,(IX+dd) */
-				SET_HIGH_REGISTER(DE, GET_BYTE(IX + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x5c:      /* LD E,IXH */
-				SET_LOW_REGISTER(DE, HIGH_REGISTER(IX));
-				break;
-
-			case 0x5d:      /* LD E,IXL */
-				SET_LOW_REGISTER(DE, LOW_REGISTER(IX));
-				break;
-
-			case 0x5e:      /* LD E,(IX+dd) */
-				SET_LOW_REGISTER(DE, GET_BYTE(IX + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x60:      /* LD IXH,B */
-				SET_HIGH_REGISTER(IX, HIGH_REGISTER(BC));
-				break;
-
-			case 0x61:      /* LD IXH,C */
-				SET_HIGH_REGISTER(IX, LOW_REGISTER(BC));
-				break;
-
-			case 0x62:      /* LD IXH,D */
-				SET_HIGH_REGISTER(IX, HIGH_REGISTER(DE));
-				break;
-
-			case 0x63:      /* LD IXH,E */
-				SET_HIGH_REGISTER(IX, LOW_REGISTER(DE));
-				break;
-
-			case 0x64:      /* LD IXH,IXH */
-				break;
-
-			case 0x65:      /* LD IXH,IXL */
-				SET_HIGH_REGISTER(IX, LOW_REGISTER(IX));
-				break;
-
-			case 0x66:      /* LD H,(IX+dd) */
-				SET_HIGH_REGISTER(HL, GET_BYTE(IX + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x67:      /* LD IXH,A */
-				SET_HIGH_REGISTER(IX, HIGH_REGISTER(AF));
-				break;
-
-			case 0x68:      /* LD IXL,B */
-				SET_LOW_REGISTER(IX, HIGH_REGISTER(BC));
-				break;
-
-			case 0x69:      /* LD IXL,C */
-				SET_LOW_REGISTER(IX, LOW_REGISTER(BC));
-				break;
-
-			case 0x6a:      /* LD IXL,D */
-				SET_LOW_REGISTER(IX, HIGH_REGISTER(DE));
-				break;
-
-			case 0x6b:      /* LD IXL,E */
-				SET_LOW_REGISTER(IX, LOW_REGISTER(DE));
-				break;
-
-			case 0x6c:      /* LD IXL,IXH */
-				SET_LOW_REGISTER(IX, HIGH_REGISTER(IX));
-				break;
-
-			case 0x6d:      /* LD IXL,IXL */
-				break;
-
-			case 0x6e:      /* LD L,(IX+dd) */
-				SET_LOW_REGISTER(HL, GET_BYTE(IX + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x6f:      /* LD IXL,A */
-				SET_LOW_REGISTER(IX, HIGH_REGISTER(AF));
-				break;
-
-			case 0x70:      /* LD (IX+dd),B */
-				PUT_BYTE(IX + (int8)RAM_PP(PC), HIGH_REGISTER(BC));
-				break;
-
-			case 0x71:      /* LD (IX+dd),C */
-				PUT_BYTE(IX + (int8)RAM_PP(PC), LOW_REGISTER(BC));
-				break;
-
-			case 0x72:      /* LD (IX+dd),D */
-				PUT_BYTE(IX + (int8)RAM_PP(PC), HIGH_REGISTER(DE));
-				break;
-
-			case 0x73:      /* LD (IX+dd),E */
-				PUT_BYTE(IX + (int8)RAM_PP(PC), LOW_REGISTER(DE));
-				break;
-
-			case 0x74:      /* LD (IX+dd),H */
-				PUT_BYTE(IX + (int8)RAM_PP(PC), HIGH_REGISTER(HL));
-				break;
-
-			case 0x75:      /* LD (IX+dd),L */
-				PUT_BYTE(IX + (int8)RAM_PP(PC), LOW_REGISTER(HL));
-				break;
-
-			case 0x77:      /* LD (IX+dd),A */
-				PUT_BYTE(IX + (int8)RAM_PP(PC), HIGH_REGISTER(AF));
-				break;
-
-			case 0x7c:      /* LD A,IXH */
-				SET_HIGH_REGISTER(AF, HIGH_REGISTER(IX));
-				break;
-
-			case 0x7d:      /* LD A,IXL */
-				SET_HIGH_REGISTER(AF, LOW_REGISTER(IX));
-				break;
-
-			case 0x7e:      /* LD A,(IX+dd) */
-				SET_HIGH_REGISTER(AF, GET_BYTE(IX + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x84:      /* ADD A,IXH */
-				temp = HIGH_REGISTER(IX);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp;
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x85:      /* ADD A,IXL */
-				temp = LOW_REGISTER(IX);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp;
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x86:      /* ADD A,(IX+dd) */
-				adr = IX + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp;
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x8c:      /* ADC A,IXH */
-				temp = HIGH_REGISTER(IX);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp + TSTFLAG(C);
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x8d:      /* ADC A,IXL */
-				temp = LOW_REGISTER(IX);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp + TSTFLAG(C);
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x8e:      /* ADC A,(IX+dd) */
-				adr = IX + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp + TSTFLAG(C);
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x96:      /* SUB (IX+dd) */
-				adr = IX + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0x94:      /* SUB IXH */
-				SETFLAG(C, 0);/* fall through, a bit less efficient but smaller code */
-
-			case 0x9c:      /* SBC A,IXH */
-				temp = HIGH_REGISTER(IX);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp - TSTFLAG(C);
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0x95:      /* SUB IXL */
-				SETFLAG(C, 0);/* fall through, a bit less efficient but smaller code */
-
-			case 0x9d:      /* SBC A,IXL */
-				temp = LOW_REGISTER(IX);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp - TSTFLAG(C);
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0x9e:      /* SBC A,(IX+dd) */
-				adr = IX + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp - TSTFLAG(C);
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xa4:      /* AND IXH */
-				AF = andTable[((AF & IX) >> 8) & 0xff];
-				break;
-
-			case 0xa5:      /* AND IXL */
-				AF = andTable[((AF >> 8)& IX) & 0xff];
-				break;
-
-			case 0xa6:      /* AND (IX+dd) */
-				AF = andTable[((AF >> 8)& GET_BYTE(IX + (int8)RAM_PP(PC))) & 0xff];
-				break;
-
-			case 0xac:      /* XOR IXH */
-				AF = xororTable[((AF ^ IX) >> 8) & 0xff];
-				break;
-
-			case 0xad:      /* XOR IXL */
-				AF = xororTable[((AF >> 8) ^ IX) & 0xff];
-				break;
-
-			case 0xae:      /* XOR (IX+dd) */
-				AF = xororTable[((AF >> 8) ^ GET_BYTE(IX + (int8)RAM_PP(PC))) & 0xff];
-				break;
-
-			case 0xb4:      /* OR IXH */
-				AF = xororTable[((AF | IX) >> 8) & 0xff];
-				break;
-
-			case 0xb5:      /* OR IXL */
-				AF = xororTable[((AF >> 8) | IX) & 0xff];
-				break;
-
-			case 0xb6:      /* OR (IX+dd) */
-				AF = xororTable[((AF >> 8) | GET_BYTE(IX + (int8)RAM_PP(PC))) & 0xff];
-				break;
-
-			case 0xbc:      /* CP IXH */
-				temp = HIGH_REGISTER(IX);
-				AF = (AF & ~0x28) | (temp & 0x28);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xbd:      /* CP IXL */
-				temp = LOW_REGISTER(IX);
-				AF = (AF & ~0x28) | (temp & 0x28);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xbe:      /* CP (IX+dd) */
-				adr = IX + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				AF = (AF & ~0x28) | (temp & 0x28);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xcb:      /* CB prefix */
-				adr = IX + (int8)RAM_PP(PC);
-				switch ((op = GET_BYTE(PC)) & 7) {
-
-				case 0:
-					++PC;
-					acu = HIGH_REGISTER(BC);
-					break;
-
-				case 1:
-					++PC;
-					acu = LOW_REGISTER(BC);
-					break;
-
-				case 2:
-					++PC;
-					acu = HIGH_REGISTER(DE);
-					break;
-
-				case 3:
-					++PC;
-					acu = LOW_REGISTER(DE);
-					break;
-
-				case 4:
-					++PC;
-					acu = HIGH_REGISTER(HL);
-					break;
-
-				case 5:
-					++PC;
-					acu = LOW_REGISTER(HL);
-					break;
-
-				case 6:
-					++PC;
-					acu = GET_BYTE(adr);
-					break;
-
-				case 7:
-					++PC;
-					acu = HIGH_REGISTER(AF);
-					break;
-				}
-				switch (op & 0xc0) {
-
-				case 0x00:  /* shift/rotate */
-					switch (op & 0x38) {
-
-					case 0x00:/* RLC */
-						temp = (acu << 1) | (acu >> 7);
-						cbits = temp & 1;
-						goto cbshflg2;
-
-					case 0x08:/* RRC */
-						temp = (acu >> 1) | (acu << 7);
-						cbits = temp & 0x80;
-						goto cbshflg2;
-
-					case 0x10:/* RL */
-						temp = (acu << 1) | TSTFLAG(C);
-						cbits = acu & 0x80;
-						goto cbshflg2;
-
-					case 0x18:/* RR */
-						temp = (acu >> 1) | (TSTFLAG(C) << 7);
-						cbits = acu & 1;
-						goto cbshflg2;
-
-					case 0x20:/* SLA */
-						temp = acu << 1;
-						cbits = acu & 0x80;
-						goto cbshflg2;
-
-					case 0x28:/* SRA */
-						temp = (acu >> 1) | (acu & 0x80);
-						cbits = acu & 1;
-						goto cbshflg2;
-
-					case 0x30:/* SLIA */
-						temp = (acu << 1) | 1;
-						cbits = acu & 0x80;
-						goto cbshflg2;
-
-					case 0x38:/* SRL */
-						temp = acu >> 1;
-						cbits = acu & 1;
-					cbshflg2:
-						AF = (AF & ~0xff) | rotateShiftTable[temp & 0xff] | !!cbits;
-					}
-					break;
-
-				case 0x40:  /* BIT */
-					if (acu & (1 << ((op >> 3) & 7)))
-						AF = (AF & ~0xfe) | 0x10 | (((op & 0x38) == 0x38) << 7);
-					else
-						AF = (AF & ~0xfe) | 0x54;
-					if ((op & 7) != 6)
-						AF |= (acu & 0x28);
-					temp = acu;
-					break;
-
-				case 0x80:  /* RES */
-					temp = acu & ~(1 << ((op >> 3) & 7));
-					break;
-
-				case 0xc0:  /* SET */
-					temp = acu | (1 << ((op >> 3) & 7));
-					break;
-				}
-				switch (op & 7) {
-
-				case 0:
-					SET_HIGH_REGISTER(BC, temp);
-					break;
-
-				case 1:
-					SET_LOW_REGISTER(BC, temp);
-					break;
-
-				case 2:
-					SET_HIGH_REGISTER(DE, temp);
-					break;
-
-				case 3:
-					SET_LOW_REGISTER(DE, temp);
-					break;
-
-				case 4:
-					SET_HIGH_REGISTER(HL, temp);
-					break;
-
-				case 5:
-					SET_LOW_REGISTER(HL, temp);
-					break;
-
-				case 6:
-					PUT_BYTE(adr, temp);
-					break;
-
-				case 7:
-					SET_HIGH_REGISTER(AF, temp);
-					break;
-				}
-				break;
-
-			case 0xe1:      /* POP IX */
-				POP(IX);
-				break;
-
-			case 0xe3:      /* EX (SP),IX */
-				temp = IX;
-				POP(IX);
-				PUSH(temp);
-				break;
-
-			case 0xe5:      /* PUSH IX */
-				PUSH(IX);
-				break;
-
-			case 0xe9:      /* JP (IX) */
-				PC = IX;
-				break;
-
-			case 0xf9:      /* LD SP,IX */
-				SP = IX;
-				break;
-
-			default:                /* ignore DD */
-				--PC;
-			}
-			break;
-
-		case 0xde:          /* SBC A,nn */
+		OPCODE(op, 0xde)          /* SBC A,nn */
 			temp = RAM_PP(PC);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
 			AF = subTable[sum & 0xff] | cbitsTable[cbits & 0x1ff] | (SET_PV);
-			break;
+			NEXT;
 
-		case 0xdf:      /* RST 18H */
+		OPCODE(op, 0xdf)      /* RST 18H */
 			PUSH(PC);
 			PC = 0x18;
-			break;
+			NEXT;
 
-		case 0xe0:      /* RET PO */
-			if (!(TSTFLAG(P)))
-				POP(PC);
-			break;
+		OPCODE(op, 0xe0)      /* RET PO */
+			RETC(!TSTFLAG(P));
+			NEXT;
 
-		case 0xe1:      /* POP HL */
+		OPCODE(op, 0xe1)      /* POP HL */
 			POP(HL);
-			break;
+			NEXT;
 
-		case 0xe2:      /* JP PO,nnnn */
+		OPCODE(op, 0xe2)      /* JP PO,nnnn */
 			JPC(!TSTFLAG(P));
-			break;
+			NEXT;
 
-		case 0xe3:      /* EX (SP),HL */
+		OPCODE(op, 0xe3)      /* EX (SP),HL */
 			temp = HL;
 			POP(HL);
 			PUSH(temp);
-			break;
+			NEXT;
 
-		case 0xe4:      /* CALL PO,nnnn */
+		OPCODE(op, 0xe4)      /* CALL PO,nnnn */
 			CALLC(!TSTFLAG(P));
-			break;
+			NEXT;
 
-		case 0xe5:      /* PUSH HL */
+		OPCODE(op, 0xe5)      /* PUSH HL */
 			PUSH(HL);
-			break;
+			NEXT;
 
-		case 0xe6:      /* AND nn */
+		OPCODE(op, 0xe6)      /* AND nn */
 			AF = andTable[((AF >> 8)& RAM_PP(PC)) & 0xff];
-			break;
+			NEXT;
 
-		case 0xe7:      /* RST 20H */
+		OPCODE(op, 0xe7)      /* RST 20H */
 			PUSH(PC);
 			PC = 0x20;
-			break;
+			NEXT;
 
-		case 0xe8:      /* RET PE */
-			if (TSTFLAG(P))
-				POP(PC);
-			break;
+		OPCODE(op, 0xe8)      /* RET PE */
+			RETC(TSTFLAG(P));
+			NEXT;
 
-		case 0xe9:      /* JP (HL) */
+		OPCODE(op, 0xe9)      /* JP (HL) */
 			PC = HL;
-			break;
+			NEXT;
 
-		case 0xea:      /* JP PE,nnnn */
+		OPCODE(op, 0xea)      /* JP PE,nnnn */
 			JPC(TSTFLAG(P));
-			break;
+			NEXT;
 
-		case 0xeb:      /* EX DE,HL */
+		OPCODE(op, 0xeb)      /* EX DE,HL */
 			temp = HL;
 			HL = DE;
 			DE = temp;
-			break;
+			NEXT;
 
-		case 0xec:      /* CALL PE,nnnn */
+		OPCODE(op, 0xec)      /* CALL PE,nnnn */
 			CALLC(TSTFLAG(P));
-			break;
+			NEXT;
 
-		case 0xed:      /* ED prefix */
+		OPCODE(op, 0xed)      /* ED prefix */
 			INCR(1); /* Add one M1 cycle to refresh counter */
-			switch (RAM_PP(PC)) {
+			DISPATCH(ed, FETCH(cyclesEDTable)) {
 
-			case 0x40:      /* IN B,(C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x40)      /* IN B,(C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_HIGH_REGISTER(BC, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x41:      /* OUT (C),B */
-				cpu_out(LOW_REGISTER(BC), HIGH_REGISTER(BC));
+			OPCODE(ed, 0x41)      /* OUT (C),B */
+				Z80out(&regs, LOW_REGISTER(BC), HIGH_REGISTER(BC));
 				break;
 
-			case 0x42:      /* SBC HL,BC */
+			OPCODE(ed, 0x42)      /* SBC HL,BC */
 				HL &= ADDRMASK;
 				BC &= ADDRMASK;
 				sum = HL - BC - TSTFLAG(C);
@@ -3488,67 +3954,67 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x43:      /* LD (nnnn),BC */
+			OPCODE(ed, 0x43)      /* LD (nnnn),BC */
 				PUT_WORD(GET_WORD(PC), BC);
 				PC += 2;
 				break;
 
-			case 0x44:      /* NEG */
+			OPCODE(ed, 0x44)      /* NEG */
 
-			case 0x4C:      /* NEG, unofficial */
+			OPCODE(ed, 0x4C)      /* NEG, unofficial */
 
-			case 0x54:      /* NEG, unofficial */
+			OPCODE(ed, 0x54)      /* NEG, unofficial */
 
-			case 0x5C:      /* NEG, unofficial */
+			OPCODE(ed, 0x5C)      /* NEG, unofficial */
 
-			case 0x64:      /* NEG, unofficial */
+			OPCODE(ed, 0x64)      /* NEG, unofficial */
 
-			case 0x6C:      /* NEG, unofficial */
+			OPCODE(ed, 0x6C)      /* NEG, unofficial */
 
-			case 0x74:      /* NEG, unofficial */
+			OPCODE(ed, 0x74)      /* NEG, unofficial */
 
-			case 0x7C:      /* NEG, unofficial */
+			OPCODE(ed, 0x7C)      /* NEG, unofficial */
 				temp = HIGH_REGISTER(AF);
 				AF = ((~(AF & 0xff00) + 1) & 0xff00); /* AF = (-(AF & 0xff00) & 0xff00); */
 				AF |= ((AF >> 8) & 0xa8) | (((AF & 0xff00) == 0) << 6) | negTable[temp];
 				break;
 
-			case 0x45:      /* RETN */
+			OPCODE(ed, 0x45)      /* RETN */
 
-			case 0x55:      /* RETN, unofficial */
+			OPCODE(ed, 0x55)      /* RETN, unofficial */
 
-			case 0x5D:      /* RETN, unofficial */
+			OPCODE(ed, 0x5D)      /* RETN, unofficial */
 
-			case 0x65:      /* RETN, unofficial */
+			OPCODE(ed, 0x65)      /* RETN, unofficial */
 
-			case 0x6D:      /* RETN, unofficial */
+			OPCODE(ed, 0x6D)      /* RETN, unofficial */
 
-			case 0x75:      /* RETN, unofficial */
+			OPCODE(ed, 0x75)      /* RETN, unofficial */
 
-			case 0x7D:      /* RETN, unofficial */
+			OPCODE(ed, 0x7D)      /* RETN, unofficial */
 				IFF |= IFF >> 1;
 				POP(PC);
 				break;
 
-			case 0x46:      /* IM 0 */
+			OPCODE(ed, 0x46)      /* IM 0 */
 							/* interrupt mode 0 */
 				break;
 
-			case 0x47:      /* LD I,A */
+			OPCODE(ed, 0x47)      /* LD I,A */
 				IR = (IR & 0xff) | (AF & ~0xff);
 				break;
 
-			case 0x48:      /* IN C,(C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x48)      /* IN C,(C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_LOW_REGISTER(BC, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x49:      /* OUT (C),C */
-				cpu_out(LOW_REGISTER(BC), LOW_REGISTER(BC));
+			OPCODE(ed, 0x49)      /* OUT (C),C */
+				Z80out(&regs, LOW_REGISTER(BC), LOW_REGISTER(BC));
 				break;
 
-			case 0x4a:      /* ADC HL,BC */
+			OPCODE(ed, 0x4a)      /* ADC HL,BC */
 				HL &= ADDRMASK;
 				BC &= ADDRMASK;
 				sum = HL + BC + TSTFLAG(C);
@@ -3557,31 +4023,32 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x4b:      /* LD BC,(nnnn) */
+			OPCODE(ed, 0x4b)      /* LD BC,(nnnn) */
 				BC = GET_WORD(GET_WORD(PC));
 				PC += 2;
 				break;
 
-			case 0x4d:      /* RETI */
+			OPCODE(ed, 0x4d)      /* RETI */
 				IFF |= IFF >> 1;
 				POP(PC);
 				break;
 
-			case 0x4f:      /* LD R,A */
+			OPCODE(ed, 0x4f)      /* LD R,A */
 				IR = (IR & ~0xff) | ((AF >> 8) & 0xff);
+				M1 = 0;
 				break;
 
-			case 0x50:      /* IN D,(C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x50)      /* IN D,(C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_HIGH_REGISTER(DE, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x51:      /* OUT (C),D */
-				cpu_out(LOW_REGISTER(BC), HIGH_REGISTER(DE));
+			OPCODE(ed, 0x51)      /* OUT (C),D */
+				Z80out(&regs, LOW_REGISTER(BC), HIGH_REGISTER(DE));
 				break;
 
-			case 0x52:      /* SBC HL,DE */
+			OPCODE(ed, 0x52)      /* SBC HL,DE */
 				HL &= ADDRMASK;
 				DE &= ADDRMASK;
 				sum = HL - DE - TSTFLAG(C);
@@ -3590,30 +4057,30 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x53:      /* LD (nnnn),DE */
+			OPCODE(ed, 0x53)      /* LD (nnnn),DE */
 				PUT_WORD(GET_WORD(PC), DE);
 				PC += 2;
 				break;
 
-			case 0x56:      /* IM 1 */
+			OPCODE(ed, 0x56)      /* IM 1 */
 							/* interrupt mode 1 */
 				break;
 
-			case 0x57:      /* LD A,I */
+			OPCODE(ed, 0x57)      /* LD A,I */
 				AF = (AF & 0x29) | (IR & ~0xff) | ((IR >> 8) & 0x80) | (((IR & ~0xff) == 0) << 6) | ((IFF & 2) << 1);
 				break;
 
-			case 0x58:      /* IN E,(C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x58)      /* IN E,(C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_LOW_REGISTER(DE, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x59:      /* OUT (C),E */
-				cpu_out(LOW_REGISTER(BC), LOW_REGISTER(DE));
+			OPCODE(ed, 0x59)      /* OUT (C),E */
+				Z80out(&regs, LOW_REGISTER(BC), LOW_REGISTER(DE));
 				break;
 
-			case 0x5a:      /* ADC HL,DE */
+			OPCODE(ed, 0x5a)      /* ADC HL,DE */
 				HL &= ADDRMASK;
 				DE &= ADDRMASK;
 				sum = HL + DE + TSTFLAG(C);
@@ -3622,31 +4089,32 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x5b:      /* LD DE,(nnnn) */
+			OPCODE(ed, 0x5b)      /* LD DE,(nnnn) */
 				DE = GET_WORD(GET_WORD(PC));
 				PC += 2;
 				break;
 
-			case 0x5e:      /* IM 2 */
+			OPCODE(ed, 0x5e)      /* IM 2 */
 							/* interrupt mode 2 */
 				break;
 
-			case 0x5f:      /* LD A,R */
+			OPCODE(ed, 0x5f)      /* LD A,R */
+				R_NOW;
 				AF = (AF & 0x29) | ((IR & 0xff) << 8) | (IR & 0x80) |
 					(((IR & 0xff) == 0) << 6) | ((IFF & 2) << 1);
 				break;
 
-			case 0x60:      /* IN H,(C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x60)      /* IN H,(C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_HIGH_REGISTER(HL, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x61:      /* OUT (C),H */
-				cpu_out(LOW_REGISTER(BC), HIGH_REGISTER(HL));
+			OPCODE(ed, 0x61)      /* OUT (C),H */
+				Z80out(&regs, LOW_REGISTER(BC), HIGH_REGISTER(HL));
 				break;
 
-			case 0x62:      /* SBC HL,HL */
+			OPCODE(ed, 0x62)      /* SBC HL,HL */
 				HL &= ADDRMASK;
 				sum = HL - HL - TSTFLAG(C);
 				AF = (AF & ~0xff) | (((sum & ADDRMASK) == 0) << 6) |
@@ -3654,29 +4122,29 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x63:      /* LD (nnnn),HL */
+			OPCODE(ed, 0x63)      /* LD (nnnn),HL */
 				PUT_WORD(GET_WORD(PC), HL);
 				PC += 2;
 				break;
 
-			case 0x67:      /* RRD */
+			OPCODE(ed, 0x67)      /* RRD */
 				temp = GET_BYTE(HL);
 				acu = HIGH_REGISTER(AF);
 				PUT_BYTE(HL, HIGH_DIGIT(temp) | (LOW_DIGIT(acu) << 4));
 				AF = rrdrldTable[(acu & 0xf0) | LOW_DIGIT(temp)] | (AF & 1);
 				break;
 
-			case 0x68:      /* IN L,(C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x68)      /* IN L,(C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_LOW_REGISTER(HL, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x69:      /* OUT (C),L */
-				cpu_out(LOW_REGISTER(BC), LOW_REGISTER(HL));
+			OPCODE(ed, 0x69)      /* OUT (C),L */
+				Z80out(&regs, LOW_REGISTER(BC), LOW_REGISTER(HL));
 				break;
 
-			case 0x6a:      /* ADC HL,HL */
+			OPCODE(ed, 0x6a)      /* ADC HL,HL */
 				HL &= ADDRMASK;
 				sum = HL + HL + TSTFLAG(C);
 				AF = (AF & ~0xff) | (((sum & ADDRMASK) == 0) << 6) |
@@ -3684,29 +4152,29 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x6b:      /* LD HL,(nnnn) */
+			OPCODE(ed, 0x6b)      /* LD HL,(nnnn) */
 				HL = GET_WORD(GET_WORD(PC));
 				PC += 2;
 				break;
 
-			case 0x6f:      /* RLD */
+			OPCODE(ed, 0x6f)      /* RLD */
 				temp = GET_BYTE(HL);
 				acu = HIGH_REGISTER(AF);
 				PUT_BYTE(HL, (LOW_DIGIT(temp) << 4) | LOW_DIGIT(acu));
 				AF = rrdrldTable[(acu & 0xf0) | HIGH_DIGIT(temp)] | (AF & 1);
 				break;
 
-			case 0x70:      /* IN (C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x70)      /* IN (C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_LOW_REGISTER(temp, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x71:      /* OUT (C),0 */
-				cpu_out(LOW_REGISTER(BC), 0);
+			OPCODE(ed, 0x71)      /* OUT (C),0 */
+				Z80out(&regs, LOW_REGISTER(BC), 0);
 				break;
 
-			case 0x72:      /* SBC HL,SP */
+			OPCODE(ed, 0x72)      /* SBC HL,SP */
 				HL &= ADDRMASK;
 				SP &= ADDRMASK;
 				sum = HL - SP - TSTFLAG(C);
@@ -3715,22 +4183,22 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x73:      /* LD (nnnn),SP */
+			OPCODE(ed, 0x73)      /* LD (nnnn),SP */
 				PUT_WORD(GET_WORD(PC), SP);
 				PC += 2;
 				break;
 
-			case 0x78:      /* IN A,(C) */
-				temp = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0x78)      /* IN A,(C) */
+				temp = Z80in(&regs, LOW_REGISTER(BC));
 				SET_HIGH_REGISTER(AF, temp);
 				AF = (AF & ~0xfe) | rotateShiftTable[temp & 0xff];
 				break;
 
-			case 0x79:      /* OUT (C),A */
-				cpu_out(LOW_REGISTER(BC), HIGH_REGISTER(AF));
+			OPCODE(ed, 0x79)      /* OUT (C),A */
+				Z80out(&regs, LOW_REGISTER(BC), HIGH_REGISTER(AF));
 				break;
 
-			case 0x7a:      /* ADC HL,SP */
+			OPCODE(ed, 0x7a)      /* ADC HL,SP */
 				HL &= ADDRMASK;
 				SP &= ADDRMASK;
 				sum = HL + SP + TSTFLAG(C);
@@ -3739,12 +4207,12 @@ static inline void Z80run(void) {
 				HL = sum;
 				break;
 
-			case 0x7b:      /* LD SP,(nnnn) */
+			OPCODE(ed, 0x7b)      /* LD SP,(nnnn) */
 				SP = GET_WORD(GET_WORD(PC));
 				PC += 2;
 				break;
 
-			case 0xa0:      /* LDI */
+			OPCODE(ed, 0xa0)      /* LDI */
 				acu = RAM_PP(HL);
 				PUT_BYTE_PP(DE, acu);
 				acu += HIGH_REGISTER(AF);
@@ -3752,7 +4220,7 @@ static inline void Z80run(void) {
 					(((--BC & ADDRMASK) != 0) << 2);
 				break;
 
-			case 0xa1:      /* CPI */
+			OPCODE(ed, 0xa1)      /* CPI */
 				acu = HIGH_REGISTER(AF);
 				temp = RAM_PP(HL);
 				sum = acu - temp;
@@ -3772,8 +4240,8 @@ static inline void Z80run(void) {
 				C - 1 if it's IND/INDR. So, first of all INI/INIR:
 				HF and CF Both set if ((HL) + ((C + 1) & 255) > 255)
 				PF The parity of (((HL) + ((C + 1) & 255)) & 7) xor B)                      */
-			case 0xa2:      /* INI */
-				acu = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0xa2)      /* INI */
+				acu = Z80in(&regs, LOW_REGISTER(BC));
 				PUT_BYTE(HL, acu);
 				++HL;
 				temp = HIGH_REGISTER(BC);
@@ -3789,16 +4257,16 @@ static inline void Z80run(void) {
 				flags is set like the parity of k bitwise and'ed with 7, bitwise xor'ed with B.
 				HF and CF Both set if ((HL) + L > 255)
 				PF The parity of ((((HL) + L) & 7) xor B)                                       */
-			case 0xa3:      /* OUTI */
+			OPCODE(ed, 0xa3)      /* OUTI */
 				acu = GET_BYTE(HL);
-				cpu_out(LOW_REGISTER(BC), acu);
+				Z80out(&regs, LOW_REGISTER(BC), acu);
 				++HL;
 				temp = HIGH_REGISTER(BC);
 				BC -= 0x100;
 				INOUTFLAGS_NONZERO(LOW_REGISTER(HL));
 				break;
 
-			case 0xa8:      /* LDD */
+			OPCODE(ed, 0xa8)      /* LDD */
 				acu = RAM_MM(HL);
 				PUT_BYTE_MM(DE, acu);
 				acu += HIGH_REGISTER(AF);
@@ -3806,7 +4274,7 @@ static inline void Z80run(void) {
 					(((--BC & ADDRMASK) != 0) << 2);
 				break;
 
-			case 0xa9:      /* CPD */
+			OPCODE(ed, 0xa9)      /* CPD */
 				acu = HIGH_REGISTER(AF);
 				temp = RAM_MM(HL);
 				sum = acu - temp;
@@ -3826,8 +4294,8 @@ static inline void Z80run(void) {
 				C - 1 if it's IND/INDR. And last IND/INDR:
 				HF and CF Both set if ((HL) + ((C - 1) & 255) > 255)
 				PF The parity of (((HL) + ((C - 1) & 255)) & 7) xor B)                      */
-			case 0xaa:      /* IND */
-				acu = cpu_in(LOW_REGISTER(BC));
+			OPCODE(ed, 0xaa)      /* IND */
+				acu = Z80in(&regs, LOW_REGISTER(BC));
 				PUT_BYTE(HL, acu);
 				--HL;
 				temp = HIGH_REGISTER(BC);
@@ -3835,19 +4303,30 @@ static inline void Z80run(void) {
 				INOUTFLAGS_NONZERO((LOW_REGISTER(BC) - 1) & 0xff);
 				break;
 
-			case 0xab:      /* OUTD */
+			OPCODE(ed, 0xab)      /* OUTD */
 				acu = GET_BYTE(HL);
-				cpu_out(LOW_REGISTER(BC), acu);
+				Z80out(&regs, LOW_REGISTER(BC), acu);
 				--HL;
 				temp = HIGH_REGISTER(BC);
 				BC -= 0x100;
 				INOUTFLAGS_NONZERO(LOW_REGISTER(HL));
 				break;
 
-			case 0xb0:      /* LDIR */
+			OPCODE(ed, 0xb0)      /* LDIR */
 				BC &= ADDRMASK;
 				if (BC == 0)
 					BC = 0x10000;
+				CYCLES(21 * (BC - 1));	/* every repetition but the last takes 21 T-states */
+				if (_RamLinear(HL, BC) && _RamLinear(DE, BC)) {	/* no wrap around */
+					INCR(2 * BC);
+					BLOCK_WRITES(DE, BC);
+					WATCH_WRITES(DE, BC);
+					_RamLdir(_RamSysAddr(DE), _RamSysAddr(HL), BC);
+					HL += BC;
+					DE += BC;
+					BC = 0;
+					acu = _RamRead(DE - 1);
+				} else
 				do {
 					INCR(2); /* Add two M1 cycles to refresh counter */
 					acu = RAM_PP(HL);
@@ -3857,17 +4336,29 @@ static inline void Z80run(void) {
 				AF = (AF & ~0x3e) | (acu & 8) | ((acu & 2) << 4);
 				break;
 
-			case 0xb1:      /* CPIR */
+			OPCODE(ed, 0xb1)      /* CPIR */
 				acu = HIGH_REGISTER(AF);
 				BC &= ADDRMASK;
 				if (BC == 0)
 					BC = 0x10000;
+				adr = BC;
+				if (_RamLinear(HL, BC)) {	/* no wrap around */
+					const uint8* p = (const uint8*)memchr(_RamSysAddr(HL), acu, BC);
+					temp = p ? p - _RamSysAddr(HL) + 1 : BC;	/* bytes compared */
+					INCR(temp);
+					HL += temp;
+					BC -= temp;
+					op = BC != 0;
+					temp = _RamRead(HL - 1);
+					sum = acu - temp;
+				} else
 				do {
 					INCR(1); /* Add one M1 cycle to refresh counter */
 					temp = RAM_PP(HL);
 					op = --BC != 0;
 					sum = acu - temp;
 				} while (op && sum != 0);
+				CYCLES(21 * (adr - BC - 1));	/* every repetition but the last takes 21 T-states */
 				cbits = acu ^ temp ^ sum;
 				AF = (AF & ~0xfe) | (sum & 0x80) | (!(sum & 0xff) << 6) |
 					(((sum - ((cbits & 16) >> 4)) & 2) << 4) |
@@ -3877,13 +4368,14 @@ static inline void Z80run(void) {
 					AF &= ~8;
 				break;
 
-			case 0xb2:      /* INIR */
+			OPCODE(ed, 0xb2)      /* INIR */
 				temp = HIGH_REGISTER(BC);
 				if (temp == 0)
 					temp = 0x100;
+				CYCLES(21 * (temp - 1));	/* every repetition but the last takes 21 T-states */
 				do {
 					INCR(1); /* Add one M1 cycle to refresh counter */
-					acu = cpu_in(LOW_REGISTER(BC));
+					acu = Z80in(&regs, LOW_REGISTER(BC));
 					PUT_BYTE(HL, acu);
 					++HL;
 				} while (--temp);
@@ -3892,14 +4384,15 @@ static inline void Z80run(void) {
 				INOUTFLAGS_ZERO((LOW_REGISTER(BC) + 1) & 0xff);
 				break;
 
-			case 0xb3:      /* OTIR */
+			OPCODE(ed, 0xb3)      /* OTIR */
 				temp = HIGH_REGISTER(BC);
 				if (temp == 0)
 					temp = 0x100;
+				CYCLES(21 * (temp - 1));	/* every repetition but the last takes 21 T-states */
 				do {
 					INCR(1); /* Add one M1 cycle to refresh counter */
 					acu = GET_BYTE(HL);
-					cpu_out(LOW_REGISTER(BC), acu);
+					Z80out(&regs, LOW_REGISTER(BC), acu);
 					++HL;
 				} while (--temp);
 				temp = HIGH_REGISTER(BC);
@@ -3907,10 +4400,22 @@ static inline void Z80run(void) {
 				INOUTFLAGS_ZERO(LOW_REGISTER(HL));
 				break;
 
-			case 0xb8:      /* LDDR */
+			OPCODE(ed, 0xb8)      /* LDDR */
 				BC &= ADDRMASK;
 				if (BC == 0)
 					BC = 0x10000;
+				CYCLES(21 * (BC - 1));	/* every repetition but the last takes 21 T-states */
+				if ((uint32)HL <= 0xffff && (uint32)HL + 1 >= (uint32)BC && (uint32)DE <= 0xffff && (uint32)DE + 1 >= (uint32)BC &&
+					_RamLinear(HL + 1 - BC, BC) && _RamLinear(DE + 1 - BC, BC)) {	/* no wrap around */
+					INCR(2 * BC);
+					BLOCK_WRITES(DE + 1 - BC, BC);
+					WATCH_WRITES(DE + 1 - BC, BC);
+					_RamLddr(_RamSysAddr(DE + 1 - BC), _RamSysAddr(HL + 1 - BC), BC);
+					HL -= BC;
+					DE -= BC;
+					BC = 0;
+					acu = _RamRead(DE + 1);
+				} else
 				do {
 					INCR(2); /* Add two M1 cycles to refresh counter */
 					acu = RAM_MM(HL);
@@ -3920,17 +4425,31 @@ static inline void Z80run(void) {
 				AF = (AF & ~0x3e) | (acu & 8) | ((acu & 2) << 4);
 				break;
 
-			case 0xb9:      /* CPDR */
+			OPCODE(ed, 0xb9)      /* CPDR */
 				acu = HIGH_REGISTER(AF);
 				BC &= ADDRMASK;
 				if (BC == 0)
 					BC = 0x10000;
+				adr = BC;
+				if ((uint32)HL <= 0xffff && (uint32)HL + 1 >= (uint32)BC && _RamLinear(HL + 1 - BC, BC)) {	/* no wrap around */
+					const uint8* p = _RamSysAddr(HL);
+					for (temp = 0; temp < (uint32)BC && p[-(int32)temp] != acu; ++temp)
+						;
+					temp = temp < (uint32)BC ? temp + 1 : BC;	/* bytes compared */
+					INCR(temp);
+					HL -= temp;
+					BC -= temp;
+					op = BC != 0;
+					temp = _RamRead(HL + 1);
+					sum = acu - temp;
+				} else
 				do {
 					INCR(1); /* Add one M1 cycle to refresh counter */
 					temp = RAM_MM(HL);
 					op = --BC != 0;
 					sum = acu - temp;
 				} while (op && sum != 0);
+				CYCLES(21 * (adr - BC - 1));	/* every repetition but the last takes 21 T-states */
 				cbits = acu ^ temp ^ sum;
 				AF = (AF & ~0xfe) | (sum & 0x80) | (!(sum & 0xff) << 6) |
 					(((sum - ((cbits & 16) >> 4)) & 2) << 4) |
@@ -3940,13 +4459,14 @@ static inline void Z80run(void) {
 					AF &= ~8;
 				break;
 
-			case 0xba:      /* INDR */
+			OPCODE(ed, 0xba)      /* INDR */
 				temp = HIGH_REGISTER(BC);
 				if (temp == 0)
 					temp = 0x100;
+				CYCLES(21 * (temp - 1));	/* every repetition but the last takes 21 T-states */
 				do {
 					INCR(1); /* Add one M1 cycle to refresh counter */
-					acu = cpu_in(LOW_REGISTER(BC));
+					acu = Z80in(&regs, LOW_REGISTER(BC));
 					PUT_BYTE(HL, acu);
 					--HL;
 				} while (--temp);
@@ -3955,14 +4475,15 @@ static inline void Z80run(void) {
 				INOUTFLAGS_ZERO((LOW_REGISTER(BC) - 1) & 0xff);
 				break;
 
-			case 0xbb:      /* OTDR */
+			OPCODE(ed, 0xbb)      /* OTDR */
 				temp = HIGH_REGISTER(BC);
 				if (temp == 0)
 					temp = 0x100;
+				CYCLES(21 * (temp - 1));	/* every repetition but the last takes 21 T-states */
 				do {
 					INCR(1); /* Add one M1 cycle to refresh counter */
 					acu = GET_BYTE(HL);
-					cpu_out(LOW_REGISTER(BC), acu);
+					Z80out(&regs, LOW_REGISTER(BC), acu);
 					--HL;
 				} while (--temp);
 				temp = HIGH_REGISTER(BC);
@@ -3970,668 +4491,216 @@ static inline void Z80run(void) {
 				INOUTFLAGS_ZERO(LOW_REGISTER(HL));
 				break;
 
-			default:    /* ignore ED and following byte */
+			OPDEFAULT(ed)    /* ignore ED and following byte */
 				break;
 			}
-			break;
+			NEXT;
 
-		case 0xee:      /* XOR nn */
+		OPCODE(op, 0xee)      /* XOR nn */
 			AF = xororTable[((AF >> 8) ^ RAM_PP(PC)) & 0xff];
-			break;
+			NEXT;
 
-		case 0xef:      /* RST 28H */
+		OPCODE(op, 0xef)      /* RST 28H */
 			PUSH(PC);
 			PC = 0x28;
-			break;
+			NEXT;
 
-		case 0xf0:      /* RET P */
-			if (!(TSTFLAG(S)))
-				POP(PC);
-			break;
+		OPCODE(op, 0xf0)      /* RET P */
+			RETC(!TSTFLAG(S));
+			NEXT;
 
-		case 0xf1:      /* POP AF */
+		OPCODE(op, 0xf1)      /* POP AF */
 			POP(AF);
-			break;
+			NEXT;
 
-		case 0xf2:      /* JP P,nnnn */
+		OPCODE(op, 0xf2)      /* JP P,nnnn */
 			JPC(!TSTFLAG(S));
-			break;
+			NEXT;
 
-		case 0xf3:      /* DI */
+		OPCODE(op, 0xf3)      /* DI */
 			IFF = 0;
-			break;
+			NEXT;
 
-		case 0xf4:      /* CALL P,nnnn */
+		OPCODE(op, 0xf4)      /* CALL P,nnnn */
 			CALLC(!TSTFLAG(S));
-			break;
+			NEXT;
 
-		case 0xf5:      /* PUSH AF */
+		OPCODE(op, 0xf5)      /* PUSH AF */
 			PUSH(AF);
-			break;
+			NEXT;
 
-		case 0xf6:      /* OR nn */
+		OPCODE(op, 0xf6)      /* OR nn */
 			AF = xororTable[((AF >> 8) | RAM_PP(PC)) & 0xff];
-			break;
+			NEXT;
 
-		case 0xf7:      /* RST 30H */
+		OPCODE(op, 0xf7)      /* RST 30H */
 			PUSH(PC);
 			PC = 0x30;
-			break;
+			NEXT;
 
-		case 0xf8:      /* RET M */
-			if (TSTFLAG(S))
-				POP(PC);
-			break;
+		OPCODE(op, 0xf8)      /* RET M */
+			RETC(TSTFLAG(S));
+			NEXT;
 
-		case 0xf9:      /* LD SP,HL */
+		OPCODE(op, 0xf9)      /* LD SP,HL */
 			SP = HL;
-			break;
+			NEXT;
 
-		case 0xfa:      /* JP M,nnnn */
+		OPCODE(op, 0xfa)      /* JP M,nnnn */
 			JPC(TSTFLAG(S));
-			break;
+			NEXT;
 
-		case 0xfb:      /* EI */
+		OPCODE(op, 0xfb)      /* EI */
 			IFF = 3;
-			break;
+			NEXT;
 
-		case 0xfc:      /* CALL M,nnnn */
+		OPCODE(op, 0xfc)      /* CALL M,nnnn */
 			CALLC(TSTFLAG(S));
-			break;
-
-		case 0xfd:      /* FD prefix */
-			INCR(1); /* Add one M1 cycle to refresh counter */
-			switch (RAM_PP(PC)) {
-
-			case 0x09:      /* ADD IY,BC */
-				IY &= ADDRMASK;
-				BC &= ADDRMASK;
-				sum = IY + BC;
-				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IY ^ BC ^ sum) >> 8];
-				IY = sum;
-				break;
-
-			case 0x19:      /* ADD IY,DE */
-				IY &= ADDRMASK;
-				DE &= ADDRMASK;
-				sum = IY + DE;
-				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IY ^ DE ^ sum) >> 8];
-				IY = sum;
-				break;
-
-			case 0x21:      /* LD IY,nnnn */
-				IY = GET_WORD(PC);
-				PC += 2;
-				break;
-
-			case 0x22:      /* LD (nnnn),IY */
-				temp = GET_WORD(PC);
-				PUT_WORD(temp, IY);
-				PC += 2;
-				break;
-
-			case 0x23:      /* INC IY */
-				++IY;
-				break;
-
-			case 0x24:      /* INC IYH */
-				IY += 0x100;
-				AF = (AF & ~0xfe) | incZ80Table[HIGH_REGISTER(IY)];
-				break;
-
-			case 0x25:      /* DEC IYH */
-				IY -= 0x100;
-				AF = (AF & ~0xfe) | decZ80Table[HIGH_REGISTER(IY)];
-				break;
-
-			case 0x26:      /* LD IYH,nn */
-				SET_HIGH_REGISTER(IY, RAM_PP(PC));
-				break;
-
-			case 0x29:      /* ADD IY,IY */
-				IY &= ADDRMASK;
-				sum = IY + IY;
-				AF = (AF & ~0x3b) | cbitsDup16Table[sum >> 8];
-				IY = sum;
-				break;
-
-			case 0x2a:      /* LD IY,(nnnn) */
-				IY = GET_WORD(GET_WORD(PC));
-				PC += 2;
-				break;
-
-			case 0x2b:      /* DEC IY */
-				--IY;
-				break;
-
-			case 0x2c:      /* INC IYL */
-				temp = LOW_REGISTER(IY) + 1;
-				SET_LOW_REGISTER(IY, temp);
-				AF = (AF & ~0xfe) | incZ80Table[temp];
-				break;
-
-			case 0x2d:      /* DEC IYL */
-				temp = LOW_REGISTER(IY) - 1;
-				SET_LOW_REGISTER(IY, temp);
-				AF = (AF & ~0xfe) | decZ80Table[temp & 0xff];
-				break;
-
-			case 0x2e:      /* LD IYL,nn */
-				SET_LOW_REGISTER(IY, RAM_PP(PC));
-				break;
-
-			case 0x34:      /* INC (IY+dd) */
-				adr = IY + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr) + 1;
-				PUT_BYTE(adr, temp);
-				AF = (AF & ~0xfe) | incZ80Table[temp];
-				break;
-
-			case 0x35:      /* DEC (IY+dd) */
-				adr = IY + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr) - 1;
-				PUT_BYTE(adr, temp);
-				AF = (AF & ~0xfe) | decZ80Table[temp & 0xff];
-				break;
-
-			case 0x36:      /* LD (IY+dd),nn */
-				adr = IY + (int8)RAM_PP(PC);
-				PUT_BYTE(adr, RAM_PP(PC));
-				break;
-
-			case 0x39:      /* ADD IY,SP */
-				IY &= ADDRMASK;
-				SP &= ADDRMASK;
-				sum = IY + SP;
-				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IY ^ SP ^ sum) >> 8];
-				IY = sum;
-				break;
-
-			case 0x44:      /* LD B,IYH */
-				SET_HIGH_REGISTER(BC, HIGH_REGISTER(IY));
-				break;
-
-			case 0x45:      /* LD B,IYL */
-				SET_HIGH_REGISTER(BC, LOW_REGISTER(IY));
-				break;
-
-			case 0x46:      /* LD B,(IY+dd) */
-				SET_HIGH_REGISTER(BC, GET_BYTE(IY + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x4c:      /* LD C,IYH */
-				SET_LOW_REGISTER(BC, HIGH_REGISTER(IY));
-				break;
-
-			case 0x4d:      /* LD C,IYL */
-				SET_LOW_REGISTER(BC, LOW_REGISTER(IY));
-				break;
-
-			case 0x4e:      /* LD C,(IY+dd) */
-				SET_LOW_REGISTER(BC, GET_BYTE(IY + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x54:      /* LD D,IYH */
-				SET_HIGH_REGISTER(DE, HIGH_REGISTER(IY));
-				break;
-
-			case 0x55:      /* LD D,IYL */
-				SET_HIGH_REGISTER(DE, LOW_REGISTER(IY));
-				break;
-
-			case 0x56:      /* LD D,(IY+dd) */
-				SET_HIGH_REGISTER(DE, GET_BYTE(IY + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x5c:      /* LD E,IYH */
-				SET_LOW_REGISTER(DE, HIGH_REGISTER(IY));
-				break;
-
-			case 0x5d:      /* LD E,IYL */
-				SET_LOW_REGISTER(DE, LOW_REGISTER(IY));
-				break;
-
-			case 0x5e:      /* LD E,(IY+dd) */
-				SET_LOW_REGISTER(DE, GET_BYTE(IY + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x60:      /* LD IYH,B */
-				SET_HIGH_REGISTER(IY, HIGH_REGISTER(BC));
-				break;
-
-			case 0x61:      /* LD IYH,C */
-				SET_HIGH_REGISTER(IY, LOW_REGISTER(BC));
-				break;
-
-			case 0x62:      /* LD IYH,D */
-				SET_HIGH_REGISTER(IY, HIGH_REGISTER(DE));
-				break;
-
-			case 0x63:      /* LD IYH,E */
-				SET_HIGH_REGISTER(IY, LOW_REGISTER(DE));
-				break;
-
-			case 0x64:      /* LD IYH,IYH */
-				break;
-
-			case 0x65:      /* LD IYH,IYL */
-				SET_HIGH_REGISTER(IY, LOW_REGISTER(IY));
-				break;
-
-			case 0x66:      /* LD H,(IY+dd) */
-				SET_HIGH_REGISTER(HL, GET_BYTE(IY + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x67:      /* LD IYH,A */
-				SET_HIGH_REGISTER(IY, HIGH_REGISTER(AF));
-				break;
-
-			case 0x68:      /* LD IYL,B */
-				SET_LOW_REGISTER(IY, HIGH_REGISTER(BC));
-				break;
-
-			case 0x69:      /* LD IYL,C */
-				SET_LOW_REGISTER(IY, LOW_REGISTER(BC));
-				break;
-
-			case 0x6a:      /* LD IYL,D */
-				SET_LOW_REGISTER(IY, HIGH_REGISTER(DE));
-				break;
-
-			case 0x6b:      /* LD IYL,E */
-				SET_LOW_REGISTER(IY, LOW_REGISTER(DE));
-				break;
-
-			case 0x6c:      /* LD IYL,IYH */
-				SET_LOW_REGISTER(IY, HIGH_REGISTER(IY));
-				break;
-
-			case 0x6d:      /* LD IYL,IYL */
-				break;
-
-			case 0x6e:      /* LD L,(IY+dd) */
-				SET_LOW_REGISTER(HL, GET_BYTE(IY + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x6f:      /* LD IYL,A */
-				SET_LOW_REGISTER(IY, HIGH_REGISTER(AF));
-				break;
-
-			case 0x70:      /* LD (IY+dd),B */
-				PUT_BYTE(IY + (int8)RAM_PP(PC), HIGH_REGISTER(BC));
-				break;
+			NEXT;
 
-			case 0x71:      /* LD (IY+dd),C */
-				PUT_BYTE(IY + (int8)RAM_PP(PC), LOW_REGISTER(BC));
-				break;
-
-			case 0x72:      /* LD (IY+dd),D */
-				PUT_BYTE(IY + (int8)RAM_PP(PC), HIGH_REGISTER(DE));
-				break;
-
-			case 0x73:      /* LD (IY+dd),E */
-				PUT_BYTE(IY + (int8)RAM_PP(PC), LOW_REGISTER(DE));
-				break;
-
-			case 0x74:      /* LD (IY+dd),H */
-				PUT_BYTE(IY + (int8)RAM_PP(PC), HIGH_REGISTER(HL));
-				break;
-
-			case 0x75:      /* LD (IY+dd),L */
-				PUT_BYTE(IY + (int8)RAM_PP(PC), LOW_REGISTER(HL));
-				break;
-
-			case 0x77:      /* LD (IY+dd),A */
-				PUT_BYTE(IY + (int8)RAM_PP(PC), HIGH_REGISTER(AF));
-				break;
-
-			case 0x7c:      /* LD A,IYH */
-				SET_HIGH_REGISTER(AF, HIGH_REGISTER(IY));
-				break;
-
-			case 0x7d:      /* LD A,IYL */
-				SET_HIGH_REGISTER(AF, LOW_REGISTER(IY));
-				break;
-
-			case 0x7e:      /* LD A,(IY+dd) */
-				SET_HIGH_REGISTER(AF, GET_BYTE(IY + (int8)RAM_PP(PC)));
-				break;
-
-			case 0x84:      /* ADD A,IYH */
-				temp = HIGH_REGISTER(IY);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp;
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x85:      /* ADD A,IYL */
-				temp = LOW_REGISTER(IY);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp;
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x86:      /* ADD A,(IY+dd) */
-				adr = IY + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp;
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x8c:      /* ADC A,IYH */
-				temp = HIGH_REGISTER(IY);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp + TSTFLAG(C);
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x8d:      /* ADC A,IYL */
-				temp = LOW_REGISTER(IY);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp + TSTFLAG(C);
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x8e:      /* ADC A,(IY+dd) */
-				adr = IY + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu + temp + TSTFLAG(C);
-				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
-				break;
-
-			case 0x96:      /* SUB (IY+dd) */
-				adr = IY + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0x94:      /* SUB IYH */
-				SETFLAG(C, 0);/* fall through, a bit less efficient but smaller code */
-
-			case 0x9c:      /* SBC A,IYH */
-				temp = HIGH_REGISTER(IY);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp - TSTFLAG(C);
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0x95:      /* SUB IYL */
-				SETFLAG(C, 0);/* fall through, a bit less efficient but smaller code */
-
-			case 0x9d:      /* SBC A,IYL */
-				temp = LOW_REGISTER(IY);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp - TSTFLAG(C);
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0x9e:      /* SBC A,(IY+dd) */
-				adr = IY + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp - TSTFLAG(C);
-				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xa4:      /* AND IYH */
-				AF = andTable[((AF & IY) >> 8) & 0xff];
-				break;
-
-			case 0xa5:      /* AND IYL */
-				AF = andTable[((AF >> 8)& IY) & 0xff];
-				break;
-
-			case 0xa6:      /* AND (IY+dd) */
-				AF = andTable[((AF >> 8)& GET_BYTE(IY + (int8)RAM_PP(PC))) & 0xff];
-				break;
-
-			case 0xac:      /* XOR IYH */
-				AF = xororTable[((AF ^ IY) >> 8) & 0xff];
-				break;
+		OPCODE(op, 0xfd)      /* FD prefix */
+#define IXY IY
+#define XY_PREFIX fd
+#define XY_CBSHFLG cbshflg3
+#include "cpu_xy.h"
 
-			case 0xad:      /* XOR IYL */
-				AF = xororTable[((AF >> 8) ^ IY) & 0xff];
-				break;
-
-			case 0xae:      /* XOR (IY+dd) */
-				AF = xororTable[((AF >> 8) ^ GET_BYTE(IY + (int8)RAM_PP(PC))) & 0xff];
-				break;
-
-			case 0xb4:      /* OR IYH */
-				AF = xororTable[((AF | IY) >> 8) & 0xff];
-				break;
-
-			case 0xb5:      /* OR IYL */
-				AF = xororTable[((AF >> 8) | IY) & 0xff];
-				break;
-
-			case 0xb6:      /* OR (IY+dd) */
-				AF = xororTable[((AF >> 8) | GET_BYTE(IY + (int8)RAM_PP(PC))) & 0xff];
-				break;
-
-			case 0xbc:      /* CP IYH */
-				temp = HIGH_REGISTER(IY);
-				AF = (AF & ~0x28) | (temp & 0x28);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xbd:      /* CP IYL */
-				temp = LOW_REGISTER(IY);
-				AF = (AF & ~0x28) | (temp & 0x28);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xbe:      /* CP (IY+dd) */
-				adr = IY + (int8)RAM_PP(PC);
-				temp = GET_BYTE(adr);
-				AF = (AF & ~0x28) | (temp & 0x28);
-				acu = HIGH_REGISTER(AF);
-				sum = acu - temp;
-				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
-				break;
-
-			case 0xcb:      /* CB prefix */
-				adr = IY + (int8)RAM_PP(PC);
-				switch ((op = GET_BYTE(PC)) & 7) {
-
-				case 0:
-					++PC;
-					acu = HIGH_REGISTER(BC);
-					break;
-
-				case 1:
-					++PC;
-					acu = LOW_REGISTER(BC);
-					break;
-
-				case 2:
-					++PC;
-					acu = HIGH_REGISTER(DE);
-					break;
-
-				case 3:
-					++PC;
-					acu = LOW_REGISTER(DE);
-					break;
-
-				case 4:
-					++PC;
-					acu = HIGH_REGISTER(HL);
-					break;
-
-				case 5:
-					++PC;
-					acu = LOW_REGISTER(HL);
-					break;
-
-				case 6:
-					++PC;
-					acu = GET_BYTE(adr);
-					break;
-
-				case 7:
-					++PC;
-					acu = HIGH_REGISTER(AF);
-					break;
-				}
-				switch (op & 0xc0) {
-
-				case 0x00:  /* shift/rotate */
-					switch (op & 0x38) {
-
-					case 0x00:/* RLC */
-						temp = (acu << 1) | (acu >> 7);
-						cbits = temp & 1;
-						goto cbshflg3;
-
-					case 0x08:/* RRC */
-						temp = (acu >> 1) | (acu << 7);
-						cbits = temp & 0x80;
-						goto cbshflg3;
-
-					case 0x10:/* RL */
-						temp = (acu << 1) | TSTFLAG(C);
-						cbits = acu & 0x80;
-						goto cbshflg3;
-
-					case 0x18:/* RR */
-						temp = (acu >> 1) | (TSTFLAG(C) << 7);
-						cbits = acu & 1;
-						goto cbshflg3;
-
-					case 0x20:/* SLA */
-						temp = acu << 1;
-						cbits = acu & 0x80;
-						goto cbshflg3;
-
-					case 0x28:/* SRA */
-						temp = (acu >> 1) | (acu & 0x80);
-						cbits = acu & 1;
-						goto cbshflg3;
-
-					case 0x30:/* SLIA */
-						temp = (acu << 1) | 1;
-						cbits = acu & 0x80;
-						goto cbshflg3;
-
-					case 0x38:/* SRL */
-						temp = acu >> 1;
-						cbits = acu & 1;
-					cbshflg3:
-						AF = (AF & ~0xff) | rotateShiftTable[temp & 0xff] | !!cbits;
-					}
-					break;
-
-				case 0x40:  /* BIT */
-					if (acu & (1 << ((op >> 3) & 7)))
-						AF = (AF & ~0xfe) | 0x10 | (((op & 0x38) == 0x38) << 7);
-					else
-						AF = (AF & ~0xfe) | 0x54;
-					if ((op & 7) != 6)
-						AF |= (acu & 0x28);
-					temp = acu;
-					break;
-
-				case 0x80:  /* RES */
-					temp = acu & ~(1 << ((op >> 3) & 7));
-					break;
-
-				case 0xc0:  /* SET */
-					temp = acu | (1 << ((op >> 3) & 7));
-					break;
-				}
-				switch (op & 7) {
-
-				case 0:
-					SET_HIGH_REGISTER(BC, temp);
-					break;
-
-				case 1:
-					SET_LOW_REGISTER(BC, temp);
-					break;
-
-				case 2:
-					SET_HIGH_REGISTER(DE, temp);
-					break;
-
-				case 3:
-					SET_LOW_REGISTER(DE, temp);
-					break;
-
-				case 4:
-					SET_HIGH_REGISTER(HL, temp);
-					break;
-
-				case 5:
-					SET_LOW_REGISTER(HL, temp);
-					break;
-
-				case 6:
-					PUT_BYTE(adr, temp);
-					break;
-
-				case 7:
-					SET_HIGH_REGISTER(AF, temp);
-					break;
-				}
-				break;
-
-			case 0xe1:      /* POP IY */
-				POP(IY);
-				break;
-
-			case 0xe3:      /* EX (SP),IY */
-				temp = IY;
-				POP(IY);
-				PUSH(temp);
-				break;
-
-			case 0xe5:      /* PUSH IY */
-				PUSH(IY);
-				break;
-
-			case 0xe9:      /* JP (IY) */
-				PC = IY;
-				break;
-
-			case 0xf9:      /* LD SP,IY */
-				SP = IY;
-				break;
-
-			default:            /* ignore FD */
-				--PC;
-			}
-			break;
-
-		case 0xfe:      /* CP nn */
+		OPCODE(op, 0xfe)      /* CP nn */
 			temp = RAM_PP(PC);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = HIGH_REGISTER(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
-				(SET_PV) | cbits2Table[cbits & 0x1ff];
-			break;
+			CP_FLAGS;
+			NEXT;
 
-		case 0xff:      /* RST 38H */
+		OPCODE(op, 0xff)      /* RST 38H */
 			PUSH(PC);
 			PC = 0x38;
+			NEXT;
 		}
 	}
+
+#ifdef Z80_BLOCKS
+	/* find (or decode) the block starting at PC and run its first instruction */
+block_lookup:
+	blk = &blockCache[(PC ^ (PC >> 6)) & (BLOCK_CACHE - 1)];
+	if (blk->uop[0].pc == (uint32)PC) {
+		++blockHits;
+	} else {
+		++blockMisses;
+		if ((uint32)PC <= 0xffff)
+			Z80blockDecode(blk, PC, opTable, ddTable, edTable, fdTable, fuseTable);
+	}
+	uop = blk->uop;
+	if ((uint32)PC == uop->pc)
+		UOP_RUN;
+	INCR(1);	/* nothing could be decoded, run the instruction from memory */
+	INSTR;
+	FLAGS_CHECK(flagsUsedTable[GET_BYTE(PC)]);
+	goto *opTable[FETCH(cyclesTable)];
+#endif
+#ifdef Z80_FUSION
+	/* superinstructions: each runs the instructions before the last one and moves on to the
+	   next with FUSE_STEP, which does what NEXT and UOP_RUN would have done in between */
+#define FUSE_STEP(x) do {                       \
+    PCX = PC;                                   \
+    INSTR;                                      \
+    ++PC;                                       \
+    INCR(1);                                    \
+    CYCLES(cyclesTable[x]);                     \
+    FLAGS_CHECK(flagsUsedTable[x]);             \
+} while (0)
+
+fuse_0x7e_0x23:		/* LD A,(HL) / INC HL */
+	SET_HIGH_REGISTER(AF, GET_BYTE(HL));
+	FUSE_STEP(0x23);
+	goto op_0x23;
+
+fuse_0x05_0x20:		/* DEC B / JR NZ */
+	BC -= 0x100;
+	temp = HIGH_REGISTER(BC);
+	AF = (AF & ~0xfe) | decTable[temp] | SET_PV2(0x7f);
+	FUSE_STEP(0x20);
+	goto op_0x20;
+
+fuse_0x05_0xc2:		/* DEC B / JP NZ */
+	BC -= 0x100;
+	temp = HIGH_REGISTER(BC);
+	AF = (AF & ~0xfe) | decTable[temp] | SET_PV2(0x7f);
+	FUSE_STEP(0xc2);
+	goto op_0xc2;
+
+fuse_0xb7_0x20:		/* OR A / JR NZ */
+	AF = xororTable[(AF >> 8) & 0xff];
+	FUSE_STEP(0x20);
+	goto op_0x20;
+
+fuse_0xb7_0x28:		/* OR A / JR Z */
+	AF = xororTable[(AF >> 8) & 0xff];
+	FUSE_STEP(0x28);
+	goto op_0x28;
+
+fuse_0xb7_0xc2:		/* OR A / JP NZ */
+	AF = xororTable[(AF >> 8) & 0xff];
+	FUSE_STEP(0xc2);
+	goto op_0xc2;
+
+fuse_0xb7_0xca:		/* OR A / JP Z */
+	AF = xororTable[(AF >> 8) & 0xff];
+	FUSE_STEP(0xca);
+	goto op_0xca;
+
+fuse_0xeb_0x19:		/* EX DE,HL / ADD HL,DE */
+	temp = HL;
+	HL = DE;
+	DE = temp;
+	FUSE_STEP(0x19);
+	goto op_0x19;
+
+fuse_0xc5_0xd5:		/* PUSH BC / PUSH DE */
+	PUSH(BC);
+	if ((uop - 1)->pc == BLOCK_END)	/* the push overwrote this block, PUSH DE may be gone */
+		NEXT;
+	FUSE_STEP(0xd5);
+	goto op_0xd5;
+
+fuse_0xd1_0xc1:		/* POP DE / POP BC */
+	POP(DE);
+	FUSE_STEP(0xc1);
+	goto op_0xc1;
+
+fuse_0x78_0xb1_0x20:	/* LD A,B / OR C / JR NZ */
+	AF = (AF & 0xff) | (BC & ~0xff);
+	FUSE_STEP(0xb1);
+	AF = xororTable[((AF >> 8) | BC) & 0xff];
+	FUSE_STEP(0x20);
+	goto op_0x20;
+
+fuse_0x78_0xb1_0xc2:	/* LD A,B / OR C / JP NZ */
+	AF = (AF & 0xff) | (BC & ~0xff);
+	FUSE_STEP(0xb1);
+	AF = xororTable[((AF >> 8) | BC) & 0xff];
+	FUSE_STEP(0xc2);
+	goto op_0xc2;
+#endif
 end_decode:
-	;
+	FLAGS_NOW;
+	Z80spill(&regs);
+#ifdef iDEBUG
+	Z80traceFlush();
+#endif
 }
+#undef AF
+#undef BC
+#undef DE
+#undef HL
+#undef IX
+#undef IY
+#undef PC
+#undef SP
+#undef IR
+#undef PCX
+#undef M1
 
 
 #endif
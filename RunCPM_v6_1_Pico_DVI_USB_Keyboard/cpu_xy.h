@@ -0,0 +1,607 @@
+// SPDX-FileCopyrightText: 2023 Mockba the Borg
+//
+// SPDX-License-Identifier: MIT
+
+/*	DD (IX) and FD (IY) instructions
+
+	Included twice inside the main switch of Z80run(), after the DD and the FD prefix, so both
+	prefixes run the same handlers: IXY names the index register (IX or IY), XY_PREFIX the
+	prefix (dd or fd, for the case labels and the threaded dispatch table) and XY_CBSHFLG a
+	label of its own. There is no include guard, and the names are undefined at the end.
+*/
+#define XY_EXPAND1(m, t) m(t)
+#define XY_EXPAND2(m, t, x) m(t, x)
+#define XY_DISPATCH(x) XY_EXPAND2(DISPATCH, XY_PREFIX, x)
+#define XY_OPCODE(x) XY_EXPAND2(OPCODE, XY_PREFIX, x)
+#define XY_DEFAULT XY_EXPAND1(OPDEFAULT, XY_PREFIX)
+#if defined(__GNUC__) && __GNUC__ >= 7	/* a fall through comment is not seen before a case label from a macro */
+#define XY_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define XY_FALLTHROUGH
+#endif
+
+			INCR(1); /* Add one M1 cycle to refresh counter */
+			XY_DISPATCH(FETCH(cyclesXXTable)) {
+
+			XY_OPCODE(0x09)      /* ADD IXY,BC */
+				IXY &= ADDRMASK;
+				BC &= ADDRMASK;
+				sum = IXY + BC;
+				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IXY ^ BC ^ sum) >> 8];
+				IXY = sum;
+				break;
+
+			XY_OPCODE(0x19)      /* ADD IXY,DE */
+				IXY &= ADDRMASK;
+				DE &= ADDRMASK;
+				sum = IXY + DE;
+				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IXY ^ DE ^ sum) >> 8];
+				IXY = sum;
+				break;
+
+			XY_OPCODE(0x21)      /* LD IXY,nnnn */
+				IXY = GET_WORD(PC);
+				PC += 2;
+				break;
+
+			XY_OPCODE(0x22)      /* LD (nnnn),IXY */
+				PUT_WORD(GET_WORD(PC), IXY);
+				PC += 2;
+				break;
+
+			XY_OPCODE(0x23)      /* INC IXY */
+				++IXY;
+				break;
+
+			XY_OPCODE(0x24)      /* INC IXYH */
+				IXY += 0x100;
+				AF = (AF & ~0xfe) | incZ80Table[HIGH_REGISTER(IXY)];
+				break;
+
+			XY_OPCODE(0x25)      /* DEC IXYH */
+				IXY -= 0x100;
+				AF = (AF & ~0xfe) | decZ80Table[HIGH_REGISTER(IXY)];
+				break;
+
+			XY_OPCODE(0x26)      /* LD IXYH,nn */
+				SET_HIGH_REGISTER(IXY, RAM_PP(PC));
+				break;
+
+			XY_OPCODE(0x29)      /* ADD IXY,IXY */
+				IXY &= ADDRMASK;
+				sum = IXY + IXY;
+				AF = (AF & ~0x3b) | cbitsDup16Table[sum >> 8];
+				IXY = sum;
+				break;
+
+			XY_OPCODE(0x2a)      /* LD IXY,(nnnn) */
+				IXY = GET_WORD(GET_WORD(PC));
+				PC += 2;
+				break;
+
+			XY_OPCODE(0x2b)      /* DEC IXY */
+				--IXY;
+				break;
+
+			XY_OPCODE(0x2c)      /* INC IXYL */
+				temp = LOW_REGISTER(IXY) + 1;
+				SET_LOW_REGISTER(IXY, temp);
+				AF = (AF & ~0xfe) | incZ80Table[temp];
+				break;
+
+			XY_OPCODE(0x2d)      /* DEC IXYL */
+				temp = LOW_REGISTER(IXY) - 1;
+				SET_LOW_REGISTER(IXY, temp);
+				AF = (AF & ~0xfe) | decZ80Table[temp & 0xff];
+				break;
+
+			XY_OPCODE(0x2e)      /* LD IXYL,nn */
+				SET_LOW_REGISTER(IXY, RAM_PP(PC));
+				break;
+
+			XY_OPCODE(0x34)      /* INC (IXY+dd) */
+				adr = IXY + (int8)RAM_PP(PC);
+				temp = GET_BYTE(adr) + 1;
+				PUT_BYTE(adr, temp);
+				AF = (AF & ~0xfe) | incZ80Table[temp];
+				break;
+
+			XY_OPCODE(0x35)      /* DEC (IXY+dd) */
+				adr = IXY + (int8)RAM_PP(PC);
+				temp = GET_BYTE(adr) - 1;
+				PUT_BYTE(adr, temp);
+				AF = (AF & ~0xfe) | decZ80Table[temp & 0xff];
+				break;
+
+			XY_OPCODE(0x36)      /* LD (IXY+dd),nn */
+				adr = IXY + (int8)RAM_PP(PC);
+				PUT_BYTE(adr, RAM_PP(PC));
+				break;
+
+			XY_OPCODE(0x39)      /* ADD IXY,SP */
+				IXY &= ADDRMASK;
+				SP &= ADDRMASK;
+				sum = IXY + SP;
+				AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) | cbitsTable[(IXY ^ SP ^ sum) >> 8];
+				IXY = sum;
+				break;
+
+			XY_OPCODE(0x44)      /* LD B,IXYH */
+				SET_HIGH_REGISTER(BC, HIGH_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x45)      /* LD B,IXYL */
+				SET_HIGH_REGISTER(BC, LOW_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x46)      /* LD B,(IXY+dd) */
+				SET_HIGH_REGISTER(BC, GET_BYTE(IXY + (int8)RAM_PP(PC)));
+				break;
+
+			XY_OPCODE(0x4c)      /* LD C,IXYH */
+				SET_LOW_REGISTER(BC, HIGH_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x4d)      /* LD C,IXYL */
+				SET_LOW_REGISTER(BC, LOW_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x4e)      /* LD C,(IXY+dd) */
+				SET_LOW_REGISTER(BC, GET_BYTE(IXY + (int8)RAM_PP(PC)));
+				break;
+
+			XY_OPCODE(0x54)      /* LD D,IXYH */
+				SET_HIGH_REGISTER(DE, HIGH_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x55)      /* LD D,IXYL */
+				SET_HIGH_REGISTER(DE, LOW_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x56)      /* LD D,(IXY+dd) */
+				SET_HIGH_REGISTER(DE, GET_BYTE(IXY + (int8)RAM_PP(PC)));
+				break;
+
+			XY_OPCODE(0x5c)      /* LD E,IXYH */
+				SET_LOW_REGISTER(DE, HIGH_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x5d)      /* LD E,IXYL */
+				SET_LOW_REGISTER(DE, LOW_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x5e)      /* LD E,(IXY+dd) */
+				SET_LOW_REGISTER(DE, GET_BYTE(IXY + (int8)RAM_PP(PC)));
+				break;
+
+			XY_OPCODE(0x60)      /* LD IXYH,B */
+				SET_HIGH_REGISTER(IXY, HIGH_REGISTER(BC));
+				break;
+
+			XY_OPCODE(0x61)      /* LD IXYH,C */
+				SET_HIGH_REGISTER(IXY, LOW_REGISTER(BC));
+				break;
+
+			XY_OPCODE(0x62)      /* LD IXYH,D */
+				SET_HIGH_REGISTER(IXY, HIGH_REGISTER(DE));
+				break;
+
+			XY_OPCODE(0x63)      /* LD IXYH,E */
+				SET_HIGH_REGISTER(IXY, LOW_REGISTER(DE));
+				break;
+
+			XY_OPCODE(0x64)      /* LD IXYH,IXYH */
+				break;
+
+			XY_OPCODE(0x65)      /* LD IXYH,IXYL */
+				SET_HIGH_REGISTER(IXY, LOW_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x66)      /* LD H,(IXY+dd) */
+				SET_HIGH_REGISTER(HL, GET_BYTE(IXY + (int8)RAM_PP(PC)));
+				break;
+
+			XY_OPCODE(0x67)      /* LD IXYH,A */
+				SET_HIGH_REGISTER(IXY, HIGH_REGISTER(AF));
+				break;
+
+			XY_OPCODE(0x68)      /* LD IXYL,B */
+				SET_LOW_REGISTER(IXY, HIGH_REGISTER(BC));
+				break;
+
+			XY_OPCODE(0x69)      /* LD IXYL,C */
+				SET_LOW_REGISTER(IXY, LOW_REGISTER(BC));
+				break;
+
+			XY_OPCODE(0x6a)      /* LD IXYL,D */
+				SET_LOW_REGISTER(IXY, HIGH_REGISTER(DE));
+				break;
+
+			XY_OPCODE(0x6b)      /* LD IXYL,E */
+				SET_LOW_REGISTER(IXY, LOW_REGISTER(DE));
+				break;
+
+			XY_OPCODE(0x6c)      /* LD IXYL,IXYH */
+				SET_LOW_REGISTER(IXY, HIGH_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x6d)      /* LD IXYL,IXYL */
+				break;
+
+			XY_OPCODE(0x6e)      /* LD L,(IXY+dd) */
+				SET_LOW_REGISTER(HL, GET_BYTE(IXY + (int8)RAM_PP(PC)));
+				break;
+
+			XY_OPCODE(0x6f)      /* LD IXYL,A */
+				SET_LOW_REGISTER(IXY, HIGH_REGISTER(AF));
+				break;
+
+			XY_OPCODE(0x70)      /* LD (IXY+dd),B */
+				PUT_BYTE(IXY + (int8)RAM_PP(PC), HIGH_REGISTER(BC));
+				break;
+
+			XY_OPCODE(0x71)      /* LD (IXY+dd),C */
+				PUT_BYTE(IXY + (int8)RAM_PP(PC), LOW_REGISTER(BC));
+				break;
+
+			XY_OPCODE(0x72)      /* LD (IXY+dd),D */
+				PUT_BYTE(IXY + (int8)RAM_PP(PC), HIGH_REGISTER(DE));
+				break;
+
+			XY_OPCODE(0x73)      /* LD (IXY+dd),E */
+				PUT_BYTE(IXY + (int8)RAM_PP(PC), LOW_REGISTER(DE));
+				break;
+
+			XY_OPCODE(0x74)      /* LD (IXY+dd),H */
+				PUT_BYTE(IXY + (int8)RAM_PP(PC), HIGH_REGISTER(HL));
+				break;
+
+			XY_OPCODE(0x75)      /* LD (IXY+dd),L */
+				PUT_BYTE(IXY + (int8)RAM_PP(PC), LOW_REGISTER(HL));
+				break;
+
+			XY_OPCODE(0x77)      /* LD (IXY+dd),A */
+				PUT_BYTE(IXY + (int8)RAM_PP(PC), HIGH_REGISTER(AF));
+				break;
+
+			XY_OPCODE(0x7c)      /* LD A,IXYH */
+				SET_HIGH_REGISTER(AF, HIGH_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x7d)      /* LD A,IXYL */
+				SET_HIGH_REGISTER(AF, LOW_REGISTER(IXY));
+				break;
+
+			XY_OPCODE(0x7e)      /* LD A,(IXY+dd) */
+				SET_HIGH_REGISTER(AF, GET_BYTE(IXY + (int8)RAM_PP(PC)));
+				break;
+
+			XY_OPCODE(0x84)      /* ADD A,IXYH */
+				temp = HIGH_REGISTER(IXY);
+				acu = HIGH_REGISTER(AF);
+				sum = acu + temp;
+				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
+				break;
+
+			XY_OPCODE(0x85)      /* ADD A,IXYL */
+				temp = LOW_REGISTER(IXY);
+				acu = HIGH_REGISTER(AF);
+				sum = acu + temp;
+				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
+				break;
+
+			XY_OPCODE(0x86)      /* ADD A,(IXY+dd) */
+				adr = IXY + (int8)RAM_PP(PC);
+				temp = GET_BYTE(adr);
+				acu = HIGH_REGISTER(AF);
+				sum = acu + temp;
+				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
+				break;
+
+			XY_OPCODE(0x8c)      /* ADC A,IXYH */
+				temp = HIGH_REGISTER(IXY);
+				acu = HIGH_REGISTER(AF);
+				sum = acu + temp + TSTFLAG(C);
+				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
+				break;
+
+			XY_OPCODE(0x8d)      /* ADC A,IXYL */
+				temp = LOW_REGISTER(IXY);
+				acu = HIGH_REGISTER(AF);
+				sum = acu + temp + TSTFLAG(C);
+				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
+				break;
+
+			XY_OPCODE(0x8e)      /* ADC A,(IXY+dd) */
+				adr = IXY + (int8)RAM_PP(PC);
+				temp = GET_BYTE(adr);
+				acu = HIGH_REGISTER(AF);
+				sum = acu + temp + TSTFLAG(C);
+				AF = addTable[sum] | cbitsZ80Table[acu ^ temp ^ sum];
+				break;
+
+			XY_OPCODE(0x96)      /* SUB (IXY+dd) */
+				adr = IXY + (int8)RAM_PP(PC);
+				temp = GET_BYTE(adr);
+				acu = HIGH_REGISTER(AF);
+				sum = acu - temp;
+				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
+				break;
+
+			XY_OPCODE(0x94)      /* SUB IXYH */
+				SETFLAG(C, 0);
+				XY_FALLTHROUGH;	/* a bit less efficient but smaller code */
+
+			XY_OPCODE(0x9c)      /* SBC A,IXYH */
+				temp = HIGH_REGISTER(IXY);
+				acu = HIGH_REGISTER(AF);
+				sum = acu - temp - TSTFLAG(C);
+				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
+				break;
+
+			XY_OPCODE(0x95)      /* SUB IXYL */
+				SETFLAG(C, 0);
+				XY_FALLTHROUGH;	/* a bit less efficient but smaller code */
+
+			XY_OPCODE(0x9d)      /* SBC A,IXYL */
+				temp = LOW_REGISTER(IXY);
+				acu = HIGH_REGISTER(AF);
+				sum = acu - temp - TSTFLAG(C);
+				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
+				break;
+
+			XY_OPCODE(0x9e)      /* SBC A,(IXY+dd) */
+				adr = IXY + (int8)RAM_PP(PC);
+				temp = GET_BYTE(adr);
+				acu = HIGH_REGISTER(AF);
+				sum = acu - temp - TSTFLAG(C);
+				AF = addTable[sum & 0xff] | cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
+				break;
+
+			XY_OPCODE(0xa4)      /* AND IXYH */
+				AF = andTable[((AF & IXY) >> 8) & 0xff];
+				break;
+
+			XY_OPCODE(0xa5)      /* AND IXYL */
+				AF = andTable[((AF >> 8)& IXY) & 0xff];
+				break;
+
+			XY_OPCODE(0xa6)      /* AND (IXY+dd) */
+				AF = andTable[((AF >> 8)& GET_BYTE(IXY + (int8)RAM_PP(PC))) & 0xff];
+				break;
+
+			XY_OPCODE(0xac)      /* XOR IXYH */
+				AF = xororTable[((AF ^ IXY) >> 8) & 0xff];
+				break;
+
+			XY_OPCODE(0xad)      /* XOR IXYL */
+				AF = xororTable[((AF >> 8) ^ IXY) & 0xff];
+				break;
+
+			XY_OPCODE(0xae)      /* XOR (IXY+dd) */
+				AF = xororTable[((AF >> 8) ^ GET_BYTE(IXY + (int8)RAM_PP(PC))) & 0xff];
+				break;
+
+			XY_OPCODE(0xb4)      /* OR IXYH */
+				AF = xororTable[((AF | IXY) >> 8) & 0xff];
+				break;
+
+			XY_OPCODE(0xb5)      /* OR IXYL */
+				AF = xororTable[((AF >> 8) | IXY) & 0xff];
+				break;
+
+			XY_OPCODE(0xb6)      /* OR (IXY+dd) */
+				AF = xororTable[((AF >> 8) | GET_BYTE(IXY + (int8)RAM_PP(PC))) & 0xff];
+				break;
+
+			XY_OPCODE(0xbc)      /* CP IXYH */
+				temp = HIGH_REGISTER(IXY);
+				AF = (AF & ~0x28) | (temp & 0x28);
+				acu = HIGH_REGISTER(AF);
+				sum = acu - temp;
+				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
+					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
+				break;
+
+			XY_OPCODE(0xbd)      /* CP IXYL */
+				temp = LOW_REGISTER(IXY);
+				AF = (AF & ~0x28) | (temp & 0x28);
+				acu = HIGH_REGISTER(AF);
+				sum = acu - temp;
+				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
+					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
+				break;
+
+			XY_OPCODE(0xbe)      /* CP (IXY+dd) */
+				adr = IXY + (int8)RAM_PP(PC);
+				temp = GET_BYTE(adr);
+				AF = (AF & ~0x28) | (temp & 0x28);
+				acu = HIGH_REGISTER(AF);
+				sum = acu - temp;
+				AF = (AF & ~0xff) | cpTable[sum & 0xff] | (temp & 0x28) |
+					cbits2Z80Table[(acu ^ temp ^ sum) & 0x1ff];
+				break;
+
+			XY_OPCODE(0xcb)      /* CB prefix */
+				adr = IXY + (int8)RAM_PP(PC);
+				switch ((op = GET_BYTE(PC)) & 7) {
+
+				case 0:
+					++PC;
+					acu = HIGH_REGISTER(BC);
+					break;
+
+				case 1:
+					++PC;
+					acu = LOW_REGISTER(BC);
+					break;
+
+				case 2:
+					++PC;
+					acu = HIGH_REGISTER(DE);
+					break;
+
+				case 3:
+					++PC;
+					acu = LOW_REGISTER(DE);
+					break;
+
+				case 4:
+					++PC;
+					acu = HIGH_REGISTER(HL);
+					break;
+
+				case 5:
+					++PC;
+					acu = LOW_REGISTER(HL);
+					break;
+
+				case 6:
+					++PC;
+					acu = GET_BYTE(adr);
+					break;
+
+				case 7:
+					++PC;
+					acu = HIGH_REGISTER(AF);
+					break;
+				}
+				CYCLES(cyclesXCBTable[op]);
+				switch (op & 0xc0) {
+
+				case 0x00:  /* shift/rotate */
+					switch (op & 0x38) {
+
+					case 0x00:/* RLC */
+						temp = (acu << 1) | (acu >> 7);
+						cbits = temp & 1;
+						goto XY_CBSHFLG;
+
+					case 0x08:/* RRC */
+						temp = (acu >> 1) | (acu << 7);
+						cbits = temp & 0x80;
+						goto XY_CBSHFLG;
+
+					case 0x10:/* RL */
+						temp = (acu << 1) | TSTFLAG(C);
+						cbits = acu & 0x80;
+						goto XY_CBSHFLG;
+
+					case 0x18:/* RR */
+						temp = (acu >> 1) | (TSTFLAG(C) << 7);
+						cbits = acu & 1;
+						goto XY_CBSHFLG;
+
+					case 0x20:/* SLA */
+						temp = acu << 1;
+						cbits = acu & 0x80;
+						goto XY_CBSHFLG;
+
+					case 0x28:/* SRA */
+						temp = (acu >> 1) | (acu & 0x80);
+						cbits = acu & 1;
+						goto XY_CBSHFLG;
+
+					case 0x30:/* SLIA */
+						temp = (acu << 1) | 1;
+						cbits = acu & 0x80;
+						goto XY_CBSHFLG;
+
+					case 0x38:/* SRL */
+						temp = acu >> 1;
+						cbits = acu & 1;
+					XY_CBSHFLG:
+						AF = (AF & ~0xff) | rotateShiftTable[temp & 0xff] | !!cbits;
+					}
+					break;
+
+				case 0x40:  /* BIT */
+					if (acu & (1 << ((op >> 3) & 7)))
+						AF = (AF & ~0xfe) | 0x10 | (((op & 0x38) == 0x38) << 7);
+					else
+						AF = (AF & ~0xfe) | 0x54;
+					if ((op & 7) != 6)
+						AF |= (acu & 0x28);
+					temp = acu;
+					break;
+
+				case 0x80:  /* RES */
+					temp = acu & ~(1 << ((op >> 3) & 7));
+					break;
+
+				case 0xc0:  /* SET */
+					temp = acu | (1 << ((op >> 3) & 7));
+					break;
+				}
+				switch (op & 7) {
+
+				case 0:
+					SET_HIGH_REGISTER(BC, temp);
+					break;
+
+				case 1:
+					SET_LOW_REGISTER(BC, temp);
+					break;
+
+				case 2:
+					SET_HIGH_REGISTER(DE, temp);
+					break;
+
+				case 3:
+					SET_LOW_REGISTER(DE, temp);
+					break;
+
+				case 4:
+					SET_HIGH_REGISTER(HL, temp);
+					break;
+
+				case 5:
+					SET_LOW_REGISTER(HL, temp);
+					break;
+
+				case 6:
+					PUT_BYTE(adr, temp);
+					break;
+
+				case 7:
+					SET_HIGH_REGISTER(AF, temp);
+					break;
+				}
+				break;
+
+			XY_OPCODE(0xe1)      /* POP IXY */
+				POP(IXY);
+				break;
+
+			XY_OPCODE(0xe3)      /* EX (SP),IXY */
+				temp = IXY;
+				POP(IXY);
+				PUSH(temp);
+				break;
+
+			XY_OPCODE(0xe5)      /* PUSH IXY */
+				PUSH(IXY);
+				break;
+
+			XY_OPCODE(0xe9)      /* JP (IXY) */
+				PC = IXY;
+				break;
+
+			XY_OPCODE(0xf9)      /* LD SP,IXY */
+				SP = IXY;
+				break;
+
+			XY_DEFAULT                   /* ignore the prefix */
+				--PC;
+			}
+			NEXT;
+
+#undef XY_EXPAND1
+#undef XY_EXPAND2
+#undef XY_DISPATCH
+#undef XY_OPCODE
+#undef XY_DEFAULT
+#undef XY_FALLTHROUGH
+#undef IXY
+#undef XY_PREFIX
+#undef XY_CBSHFLG
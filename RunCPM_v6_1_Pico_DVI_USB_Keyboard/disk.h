@@ -57,6 +57,10 @@ int _SelectDisk(uint8 dr) {
 	}
 
 	disk[0] += dr;
+#if defined(FILE_CACHE) || defined(DIR_CACHE)
+	if (loginVector & (1 << dr))	// Already seen on the card since the last disk reset
+		return(0x00);
+#endif
 	if (_sys_select(&disk[0])) {
 		loginVector = loginVector | (1 << (disk[0] - 'A'));
 		result = 0x00;
@@ -315,9 +319,12 @@ uint8 _CloseFile(uint16 fcbaddr) {
 		if (!(F->s2 & 0x80)) {					// if file is modified
 			if (!RW) {
 				_FCBtoHostname(fcbaddr, &filename[0]);
-				if (fcbaddr == BatchFCB)
-					_Truncate((char*)filename, F->rc);	// Truncate $$$.SUB to F->rc CP/M records so SUBMIT.COM can work
-				result = 0x00;
+				_sys_cacheflush(&filename[0]);		// Data and size go to the card now (see FILE_CACHE)
+				if (!_sys_cacheerror(&filename[0])) {	// Unless they can't (see WRITEBACK)
+					if (fcbaddr == BatchFCB)
+						_Truncate((char*)filename, F->rc);	// Truncate $$$.SUB to F->rc CP/M records so SUBMIT.COM can work
+					result = 0x00;
+				}
 			} else {
 				_error(errWRITEPROT);
 			}
@@ -620,6 +627,114 @@ uint8 _CheckSUB(void) {
 	return(result);
 }
 
+#ifdef SNAPSHOT
+/*	Machine snapshots
+
+	A snapshot file holds a SNAPHDR byte header with the Z80 registers and the BDOS state
+	(stored as 16 bit little endian words after the magic), followed by the whole RAM[].
+	An open directory search can't be carried over, a search running at the time must be
+	started again. The screen contents aren't part of it either.
+*/
+#define SNAPHDR 128
+#define SNAPMAGIC "RunCPM SNAP1"			// 12 characters, ends the magic before the words
+
+static uint8 snapName[17];					// Host file name for the snapshot armed by the CCP SNAP command
+static uint8 snapNext = FALSE;				// TRUE when the next program run by the CCP is to be snapshot
+static uint8 snapArmed = FALSE;				// TRUE while that program runs and hasn't been snapshot yet
+
+static uint8 _SnapshotWord(uint8* hdr, uint8 i, int32* v, uint8 save) {	// Stores or loads word i of the header
+	hdr += 12 + i * 2;
+	if (save) {
+		hdr[0] = *v & 0xff;
+		hdr[1] = (*v >> 8) & 0xff;
+	} else {
+		*v = hdr[0] | (hdr[1] << 8);
+	}
+	return(i + 1);
+}
+
+static void _SnapshotState(uint8* hdr, uint8 save) {	// Moves the machine state to or from the header
+	int32 v;
+	uint8 i = 0;
+
+	i = _SnapshotWord(hdr, i, &AF, save);
+	i = _SnapshotWord(hdr, i, &BC, save);
+	i = _SnapshotWord(hdr, i, &DE, save);
+	i = _SnapshotWord(hdr, i, &HL, save);
+	i = _SnapshotWord(hdr, i, &IX, save);
+	i = _SnapshotWord(hdr, i, &IY, save);
+	i = _SnapshotWord(hdr, i, &PC, save);
+	i = _SnapshotWord(hdr, i, &SP, save);
+	i = _SnapshotWord(hdr, i, &AF1, save);
+	i = _SnapshotWord(hdr, i, &BC1, save);
+	i = _SnapshotWord(hdr, i, &DE1, save);
+	i = _SnapshotWord(hdr, i, &HL1, save);
+	i = _SnapshotWord(hdr, i, &IR, save);
+	i = _SnapshotWord(hdr, i, &IFF, save);
+#define SNAPVAR(x) v = x; i = _SnapshotWord(hdr, i, &v, save); x = v
+	SNAPVAR(dmaAddr);
+	SNAPVAR(oDrive);
+	SNAPVAR(cDrive);
+	SNAPVAR(userCode);
+	SNAPVAR(roVector);
+	SNAPVAR(loginVector);
+	SNAPVAR(allUsers);
+	SNAPVAR(allExtents);
+	SNAPVAR(currFindUser);
+	SNAPVAR(curBank);
+	SNAPVAR(mask8bit);
+#undef SNAPVAR
+	if (save)
+		memcpy(hdr + 12 + i * 2, pattern, sizeof(pattern));
+	else
+		memcpy(pattern, hdr + 12 + i * 2, sizeof(pattern));
+}
+
+// Saves the whole machine, resuming it continues at pc
+uint8 _SaveSnapshot(uint8* name, uint16 pc) {
+	uint8 hdr[SNAPHDR];
+	int32 oPC = PC;
+
+	memset(hdr, 0, SNAPHDR);
+	memcpy(hdr, SNAPMAGIC, 12);
+	hdr[SNAPHDR - 4] = TPASIZE;				// Only a snapshot of the same memory layout can be loaded
+	hdr[SNAPHDR - 3] = BANKS;
+	hdr[SNAPHDR - 2] = BDOSjmppage >> 8;
+	hdr[SNAPHDR - 1] = BIOSjmppage >> 8;
+	PC = pc;
+	_SnapshotState(hdr, TRUE);
+	PC = oPC;
+	return(_sys_writefile(name, hdr, SNAPHDR, RAM, MEMSIZE) ? 0x00 : 0xff);
+}
+
+// Loads a snapshot saved by _SaveSnapshot, the Z80 continues from it
+uint8 _LoadSnapshot(uint8* name) {
+	uint8 hdr[SNAPHDR];
+
+	if (!_sys_readfile(name, 0, hdr, SNAPHDR) || memcmp(hdr, SNAPMAGIC, 12) ||
+		hdr[SNAPHDR - 4] != TPASIZE || hdr[SNAPHDR - 3] != BANKS ||
+		hdr[SNAPHDR - 2] != (uint8)(BDOSjmppage >> 8) || hdr[SNAPHDR - 1] != (uint8)(BIOSjmppage >> 8))
+		return(0xff);
+	if (_sys_filesize(name) != SNAPHDR + MEMSIZE)	// Short or truncated, RAM is left alone
+		return(0xff);
+	if (!_sys_readfile(name, SNAPHDR, RAM, MEMSIZE)) {
+		_puts("\r\nUnable to read the snapshot.\r\n");
+		Status = 2;							// RAM is only partly loaded, nothing to go back to but a warm boot
+		return(0xff);
+	}
+	_SnapshotState(hdr, FALSE);
+	BLOCK_FLUSH;
+	return(0x00);
+}
+
+// Takes the snapshot armed by the CCP SNAP command, when the program first waits for the console
+void _SnapshotArmed(void) {
+	snapArmed = FALSE;
+	if (_SaveSnapshot(snapName, PCX))		// Resuming repeats the console call the program was making
+		_puts("\r\nUnable to save the snapshot.\r\n");
+}
+#endif
+
 #ifdef HASLUA
 // Executes a Lua script
 uint8 _RunLua(uint16 fcbaddr) {
@@ -13,13 +13,46 @@
 /* Definition for enabling incrementing the R register for each M1 cycle */
 #define DO_INCR
 
+/* Definition for using threaded (computed goto) instruction dispatch instead of a switch (GCC/Clang only) */
+//#define THREADED
+//#define BLOCK_CACHE 128	// If defined (requires THREADED) straight-line code is predecoded into this many cached blocks (a power of 2)
+							// PROFILE shows the hit/miss/invalidation counters, to check whether it pays off
+//#define FUSION			// If defined (requires BLOCK_CACHE) common instruction pairs/triples run as one micro-op
+
+/* Definition for running the Z80 core from SRAM instead of through the XIP flash cache (RP2040 only) */
+//#define SRAM_CORE			// Z80run() and the tables it reads on every instruction are copied to SRAM at boot
+
+/* Definition for counting the T-states taken by each instruction (read back by BDOS call 247) */
+//#define DO_CYCLES
+//#define THROTTLE 4000000	// If defined (requires DO_CYCLES) emulation is slowed down to this Z80 clock in Hz
+
+/* Definition for working out the flags of ADD/SUB/CP only when a later instruction needs them */
+//#define LAZY_FLAGS
+
+/* Definition for putting the CPU to sleep while a program just polls the console for a key */
+//#define IDLE_POLLS 32		// If defined a program polling this many times in a row without input or output is idle
+#define IDLE_GAP 200		// With DO_INCR polls only count when less than this many M1 cycles apart, a program working in between is not idle
+#define IDLE_WAIT 20		// Each poll of an idle program then waits up to this many ms for a key (PROFILE shows the counts)
+
+/* Definition for sleeping through a HALT instead of returning to the CCP */
+//#define HALT_WAIT 20		// If defined a HALT with interrupts enabled sleeps until a key or this many ms (a timer tick) pass
+
+/* Definition for keeping the files a program uses open between BDOS calls */
+//#define FILE_CACHE 4		// If defined this many host files are kept open, the least recently used one is closed first
+//#define READAHEAD 4096	// If defined (requires FILE_CACHE) sequential reads go through a window of this many bytes per open file
+//#define WRITEBACK 4096	// If defined (requires FILE_CACHE) records written in a row are gathered in a buffer of this many bytes (a power of 2) per open file
+#define WRITEBACK_WAIT 1000	// Milliseconds written records may wait in the WRITEBACK buffer
+
+/* Definition for keeping the file names and sizes of a folder in memory */
+//#define DIR_CACHE 128		// If defined up to this many files of the last searched drive/user folder are indexed in memory
+
 /* Definitions for enabling PUN: and LST: devices */
 #define USE_PUN	// The pun.txt and lst.txt files will appear on drive A: user 0
 #define USE_LST
 
 /* Definitions for file/console based debugging */
 // #define DEBUG			// Enables the internal debugger (enabled by default on vstudio debug builds)
-//#define iDEBUG			// Enables instruction logging onto iDebug.log (for development debug only)
+//#define iDEBUG			// Enables instruction tracing onto iDump.bin, "RunCPM -t" decodes it into iDump.log (for development debug only)
 // #define DEBUGLOG			// Writes extensive call trace information to RunCPM.log
 //#define CONSOLELOG		// Writes debug information to console instead of file
 //#define LOGBIOS_NOT 01	// If defined will not log this BIOS function number
@@ -101,6 +134,12 @@
 
 //#define PROFILE					// For measuring time taken to run a CP/M command
 									// This should be enabled only for debugging purposes when trying to improve emulation speed
+//#define PAIRS 1024				// If defined (requires PROFILE) PROFILE also shows the most frequent opcode pairs
+									// out of this many (a power of 2) counted, to choose what FUSION should fuse
+
+//#define SNAPSHOT					// Enables saving/resuming the whole machine (BDOS calls 245/246, CCP SNAP/RESUME)
+//#define KEYLOG					// Enables recording console input and replaying it at the same points (CCP RECORD/REPLAY)
+									// Replay ignores the live keyboard, for rerunning interactive programs identically
 
 #define NOHIGHUSER					// Prevents the creation of user folders above 'F' (15) by programs
 									// Original CP/M BDOS allows it, but I prefer to keep the folders clean
@@ -125,6 +164,7 @@ typedef signed int      int32;
 typedef unsigned char   uint8;
 typedef unsigned short  uint16;
 typedef unsigned int    uint32;
+typedef unsigned long long uint64;
 
 #define LOW_DIGIT(x)     ((x) & 0xf)
 #define HIGH_DIGIT(x)    (((x) >> 4) & 0xf)
@@ -156,19 +196,22 @@ typedef unsigned int    uint32;
 									          // For TPASIZE<60 CCP ORG = (SIZEK * 1024) - 0x0C00
 
 #define BANKS 1						// Number of memory banks available
-static uint8 curBank = 1;			// Number of the current RAM bank in use (1-x, not 0-x)
+static uint8 curBank = 1;			// Number of the current RAM bank in use (0 is the system bank, 1 the TPA bank)
 static uint8 isXmove = FALSE;		// Used by BIOS
 static uint8 srcBank = 1;			// Source bank for memory MOVE
 static uint8 dstBank = 1;			// Destination bank for memory MOVE
 static uint8 ioBank = 1;			// Destination bank for sector IO
 
 #define PAGESIZE 64 * 1024			// RAM(plus ROM) needs to be 64K to avoid compatibility issues
-#define MEMSIZE PAGESIZE * BANKS	// Total RAM size
 
 #if BANKS==1
+#define MEMSIZE PAGESIZE * BANKS	// Total RAM size
+#else
+#define COMMONaddr 0xC000			// Memory from here up is common to all banks, below it each bank has its own (CP/M 3 style)
+#define MEMSIZE (PAGESIZE + (BANKS - 1) * COMMONaddr)	// Total RAM size (the current bank plus the banked part of the others, see ram.h)
+#endif
 #define RAM_FAST					// If this is defined, all RAM function calls become direct access (see below)
 									// This saves about 2K on the Arduino code and should bring speed improvements
-#endif
 
 #ifdef RAM_FAST						// Makes all function calls to memory access into direct RAM access (less calls / less code)
 	static uint8 RAM[MEMSIZE];
@@ -177,6 +220,22 @@ static uint8 ioBank = 1;			// Destination bank for sector IO
 	#define _RamRead16(a)		((RAM[((a) & 0xffff) + 1] << 8) | RAM[(a) & 0xffff])
 	#define _RamWrite(a, v)		RAM[a] = v
 	#define _RamWrite16(a, v)	RAM[a] = (v) & 0xff; RAM[(a) + 1] = (v) >> 8
+#else								// The current bank is always at the bottom of RAM[] (see ram.h)
+	static uint8 RAM[MEMSIZE];
+	static inline uint8* _RamSysAddr(uint16 a)			{ return(&RAM[a]); }
+	static inline uint8 _RamRead(uint16 a)				{ return(RAM[a]); }
+	static inline uint16 _RamRead16(uint16 a)			{ return(_RamRead(a) | (_RamRead(a + 1) << 8)); }
+	static inline void _RamWrite(uint16 a, uint8 v)		{ RAM[a] = v; }
+	static inline void _RamWrite16(uint16 a, uint16 v)	{ _RamWrite(a, v & 0xff); _RamWrite(a + 1, v >> 8); }
+#endif
+#define _RamLinear(a, n)		((uint32)(a) <= 0xffff && (uint32)(a) + (n) <= 0x10000)	// True when a is a valid address and n bytes from it can be used through one pointer
+
+#if defined(SRAM_CORE) && defined(ARDUINO_ARCH_RP2040)	// Places the Z80 core in SRAM (see SRAM_CORE above)
+	#define SRAM_FUNC			__attribute__((noinline)) __not_in_flash("runcpm.code")	// Kept out of line, or it would go back to flash with its caller
+	#define SRAM_DATA			__not_in_flash("runcpm.data")
+#else
+	#define SRAM_FUNC			inline
+	#define SRAM_DATA
 #endif
 
 // Size of the allocated pages (Minimum size = 1 page = 256 bytes)
@@ -233,11 +292,6 @@ extern "C"
 {
 #endif
 
-#ifndef RAM_FAST
-	extern uint8* _RamSysAddr(uint16 address);
-	extern void _RamWrite(uint16 address, uint8 value);
-#endif
-
 	extern void _Bdos(void);
 	extern void _Bios(void);
 
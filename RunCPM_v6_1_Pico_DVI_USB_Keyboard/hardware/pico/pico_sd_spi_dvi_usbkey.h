@@ -28,6 +28,29 @@
 #define USE_MSC (0)
 #endif
 
+// Console output passes through a lock-free ring (ring.h), as the keys always do. The emulation
+// then never touches the USB host or the framebuffer. The USB host timer only raises a software
+// interrupt of the lowest priority when there is output, which then draws up to CONSOLE_SLICE
+// characters, so drawing and scrolling never hold up the timer or other interrupts.
+// Core 1 is taken by the PicoDVI scan-out, so this service task stays on core 0.
+//#define CONSOLE_RING
+
+#ifdef CONSOLE_RING
+#if !(USE_DISPLAY && USE_KEYBOARD)
+#error CONSOLE_RING needs both USE_DISPLAY and USE_KEYBOARD
+#endif
+#include "hardware/irq.h"
+
+#define CONSOLE_SLICE 16     // Characters drawn per USB host timer tick at most
+#define CONSOLE_WAIT 20000   // us a full ring waits for the service task before drawing in place
+
+static int consoleIrq;    // The software interrupt drawing the output
+
+ring_t conRing;   // Console output, from the emulation to the service task
+
+void console_service(void);
+#endif
+
 
 uint8_t getch_serial1(void) {
   while (true) {
@@ -43,34 +66,20 @@ bool kbhit_serial1(void) {
 }
 
 
-#define USBH_KEY_BUFFER_SIZE 64
+#include "../../ring.h"
 
-uint8_t usbhkbuf[USBH_KEY_BUFFER_SIZE];
-uint8_t usbhkbufnum = 0;
+ring_t keyRing;   // USB keys, from the timer interrupt to the emulation, in the order typed
 
 bool usbhkbd_write(uint8_t code) {
-  if (usbhkbufnum > USBH_KEY_BUFFER_SIZE) {
-    return false;
-  } else {
-    usbhkbuf[usbhkbufnum] = code;
-    usbhkbufnum++;
-    return true;
-  }
+  return _ring_put(&keyRing, code);
 }
 
 uint8_t usbhkbd_available(void) {
-  if (usbhkbufnum == 0) return 0;
-  else return usbhkbufnum;
+  return _ring_count(&keyRing) != 0;
 }
 
 int usbhkbd_read(void) {
-  if (usbhkbufnum == 0) {
-    return (-1);
-  } else {
-    usbhkbufnum--;
-    uint8_t code = usbhkbuf[usbhkbufnum];
-    return code;
-  }
+  return _ring_get(&keyRing);
 }
 
 uint8_t getch_usbh(void) {
@@ -144,6 +153,10 @@ void usb_host_task(void) {
 
 bool timer_callback(repeating_timer_t *rtimer) {  // USB Host is executed by timer interrupt.
   usb_host_task();
+#ifdef CONSOLE_RING
+  if( _ring_count(&conRing) )
+    irq_set_pending(consoleIrq);  // Drawn once this interrupt returns (console_service)
+#endif
   return true;
 }
 
@@ -1120,6 +1133,29 @@ void putch_display(uint8_t c)
   else
     terminal_receive_char_vt52(c);
 }
+
+#ifdef CONSOLE_RING
+void putch_ring(uint8_t c)
+{
+  uint32_t start = time_us_32();
+  while( !_ring_put(&conRing, c) ) {
+    if( time_us_32() - start < CONSOLE_WAIT ) {
+      __wfe();  // Full, the next timer tick draws some of it
+    } else {    // The service task isn't running (no timer ticks, or called from a higher priority)
+      irq_set_enabled(consoleIrq, false);
+      console_service();
+      irq_set_enabled(consoleIrq, true);
+    }
+  }
+}
+
+void console_service(void)  // Draws some of what the emulation has written
+{
+  int c, n = CONSOLE_SLICE;
+  while( n-- && (c = _ring_get(&conRing)) != -1 )
+    putch_display(c);
+}
+#endif
 #endif
 
 
@@ -1134,8 +1170,16 @@ bool port_init_early() {
 
   terminal_reset();
   terminal_clear_screen();
+#ifdef CONSOLE_RING
+  consoleIrq = user_irq_claim_unused(true);
+  irq_set_exclusive_handler(consoleIrq, console_service);
+  irq_set_priority(consoleIrq, PICO_LOWEST_IRQ_PRIORITY);
+  irq_set_enabled(consoleIrq, true);
+  _putch_hook = putch_ring;
+#else
   _putch_hook = putch_display;
 #endif
+#endif
 
 #if USE_KEYBOARD
   USBHost.begin(0);
@@ -60,6 +60,11 @@ int lst_open = FALSE;
 
 int main(int argc, char* argv[]) {
 
+#ifdef iDEBUG
+	if (argc > 1 && !strcmp(argv[1], "-t"))	// Turns the iDump.bin instruction trace into iDump.log and exits
+		return(Z80traceDecode("iDump.bin", "iDump.log"));
+#endif
+
 #ifdef DEBUGLOG
 	_sys_deletefile((uint8*)LogName);
 #endif
@@ -7,46 +7,113 @@
 
 /* see main.c for definition */
 
-#ifndef RAM_FAST
-static uint8 RAM[MEMSIZE];			// Definition of the emulated RAM
+/*	Banked memory
 
-uint8* _RamSysAddr(uint16 address) {
-	if (address < CCPaddr) {
-		return(&RAM[address * curBank]);
-	} else {
-		return(&RAM[address]);
-	}
+	With more than one bank, the memory from COMMONaddr up is common to all of them and below
+	it every bank has its own. The selected bank always sits at the bottom of RAM[], so the
+	core reaches it as directly as a single bank (RAM_FAST). After the 64K, RAM[] holds the
+	banked part of the other banks, that of bank b > 0 in its slot, _RamSlot(b). Bank 0 has no
+	slot: while another bank is selected, it is kept in the slot of that bank. Selecting a bank
+	swaps its banked part in, so a switch copies two or four times COMMONaddr bytes, which only
+	BIOS SELMEM does (the BDOS is not banked), instead of every access looking up the bank.
+*/
+#if BANKS == 1
+#define _RamBankAddr(bank, a)	&RAM[a]
+#define _RamBankEnd(a)			0x10000
+#define _RamSelect(bank)		curBank = (bank)
+#else
+// Banked part of bank b > 0 when it is not selected
+#define _RamSlot(b)				&RAM[PAGESIZE + ((b) - 1) * COMMONaddr]
+
+// End of the contiguous part of a bank holding address a
+#define _RamBankEnd(a)			((a) < COMMONaddr ? COMMONaddr : 0x10000)
+
+// Pointer to address a of any bank (bank numbers wrap around)
+uint8* _RamBankAddr(uint8 bank, uint16 a) {
+	bank %= BANKS;
+	if (a >= COMMONaddr || bank == curBank)
+		return(&RAM[a]);
+	return(&(bank ? _RamSlot(bank) : _RamSlot(curBank))[a]);
 }
 
-uint8 _RamRead(uint16 address) {
-	if (address < CCPaddr) {
-		return(RAM[address * curBank]);
-	} else {
-		return(RAM[address]);
+// Swaps the banked part of the selected bank with a slot
+static void _RamSwap(uint8* slot) {
+	uint8 buf[256];
+	uint8* p;
+
+	for (p = RAM; p < &RAM[COMMONaddr]; p += sizeof(buf), slot += sizeof(buf)) {
+		memcpy(buf, p, sizeof(buf));
+		memcpy(p, slot, sizeof(buf));
+		memcpy(slot, buf, sizeof(buf));
 	}
 }
 
-uint16 _RamRead16(uint16 address) {
-	if (address < CCPaddr) {
-		return(RAM[address * curBank] + (RAM[(address * curBank) + 1] << 8));
+// Maps a bank in (BIOS SELMEM)
+void _RamSelect(uint8 bank) {
+	bank %= BANKS;
+	if (bank == curBank)
+		return;
+	if (curBank)				// Bank 0 back from the slot of the current bank
+		_RamSwap(_RamSlot(curBank));
+	if (bank)					// and out to the slot of the new one
+		_RamSwap(_RamSlot(bank));
+	curBank = bank;
+}
+#endif
+
+/*	Bulk copies for LDIR/LDDR on blocks that do not wrap around
+
+	Byte by byte, a copy onto a block overlapping the source ahead of it (in the direction
+	of the copy) keeps repeating the first dst - src bytes, so that case is done in
+	chunks of that size (a single byte becomes a fill), anything else is a plain memmove.
+	Both take the lowest addresses of the blocks.
+*/
+static void _RamLdir(uint8* dst, const uint8* src, uint32 len) {
+	uint32 n;
+
+	if (dst <= src || dst >= src + len) {
+		memmove(dst, src, len);
+	} else if (dst == src + 1) {
+		memset(dst, *src, len);
 	} else {
-		return(RAM[address] + (RAM[address + 1] << 8));
+		for (; len; len -= n, dst += n, src += n) {
+			n = dst - src < len ? dst - src : len;
+			memcpy(dst, src, n);
+		}
 	}
 }
 
-void _RamWrite(uint16 address, uint8 value) {
-	if (address < CCPaddr) {
-		RAM[address * curBank] = value;
+static void _RamLddr(uint8* dst, const uint8* src, uint32 len) {
+	uint32 n;
+
+	if (dst >= src || dst + len <= src) {
+		memmove(dst, src, len);
+	} else if (dst + 1 == src) {
+		memset(dst, src[len - 1], len);
 	} else {
-		RAM[address] = value;
+		for (; len; len -= n) {
+			n = src - dst < len ? src - dst : len;
+			memcpy(dst + len - n, src + len - n, n);
+		}
 	}
 }
 
-void _RamWrite16(uint16 address, uint16 value) {
-	// Z80 is a "little indian" (8 bit era joke)
-	_RamWrite(address, value & 0xff);
-	_RamWrite(address + 1, (value >> 8) & 0xff);
-}
+// Copies len bytes from src in bank sBank to dst in bank dBank the way LDIR would (BIOS MOVE/XMOVE)
+void _RamMove(uint8 dBank, uint16 dst, uint8 sBank, uint16 src, uint32 len) {
+	uint32 n;
+
+#if BANKS == 1
+	(void)dBank;
+	(void)sBank;
 #endif
+	for (; len; len -= n, dst += n, src += n) {
+		n = len;
+		if ((uint32)dst + n > _RamBankEnd(dst))	// Up to the end of a contiguous part of either block
+			n = _RamBankEnd(dst) - dst;
+		if ((uint32)src + n > _RamBankEnd(src))
+			n = _RamBankEnd(src) - src;
+		_RamLdir(_RamBankAddr(dBank, dst), _RamBankAddr(sBank, src), n);
+	}
+}
 
 #endif
@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2023 Mockba the Borg
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef RING_H
+#define RING_H
+
+/* Lock-free single-producer/single-consumer byte ring
+   One side only calls _ring_put(), the other only _ring_get() and _ring_count(), so they
+   can run on different cores, or one of them in an interrupt, without taking a lock.
+*/
+#define RING_SIZE 256		// Must be a power of 2
+
+typedef struct {
+	uint32 head;			// Next slot to write, only changed by the producer
+	uint32 tail;			// Next slot to read, only changed by the consumer
+	uint8 buf[RING_SIZE];
+} ring_t;
+
+static inline bool _ring_put(ring_t* r, uint8 ch)	// Adds a byte, false if the ring is full
+{
+	uint32 head = r->head;
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == RING_SIZE)
+		return(false);
+	r->buf[head & (RING_SIZE - 1)] = ch;
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return(true);
+}
+
+static inline uint32 _ring_count(ring_t* r)		// Number of bytes waiting
+{
+	return(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail);
+}
+
+static inline int _ring_get(ring_t* r)			// Takes a byte, -1 if the ring is empty
+{
+	uint32 tail = r->tail;
+	if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+		return(-1);
+	uint8 ch = r->buf[tail & (RING_SIZE - 1)];
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return(ch);
+}
+
+#endif
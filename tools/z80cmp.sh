@@ -0,0 +1,10 @@
+#!/bin/sh
+# Compares two outputs of "z80test random", skipping the runs either build stopped at READ_LIMIT
+# usage: z80cmp.sh a.txt b.txt
+grep -v LIMIT "$1" | sort > /tmp/z80cmp.a
+grep -v LIMIT "$2" | sort > /tmp/z80cmp.b
+join /tmp/z80cmp.a /tmp/z80cmp.b | awk '{
+	n++; m = (NF - 1) / 2; same = 1
+	for (i = 2; i <= m + 1; i++) if ($i != $(i + m)) same = 0
+	if (!same) { bad++; if (bad <= 5) print "differs:", $0 }
+} END { print n + 0, "runs compared,", bad + 0, "differ"; exit bad > 0 }'
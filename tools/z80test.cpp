@@ -0,0 +1,562 @@
+// SPDX-FileCopyrightText: 2023 Mockba the Borg
+//
+// SPDX-License-Identifier: MIT
+
+/*
+	z80test - Runs the Z80 core from cpu.h headless on the host
+
+	Build from the repository root, with any of the core's options (THREADED, BLOCK_CACHE=128,
+	LAZY_FLAGS, ...) added as -D flags:
+
+		g++ -O2 -Wall -Wextra -I RunCPM_v6_1_Pico_DVI_USB_Keyboard tools/z80test.cpp -o z80test
+		(add -fsanitize=address -g to catch accesses outside RAM[])
+
+	or from tools/, make check (builds with -Werror, then runs regress and bench 1).
+
+	Modes:
+		z80test regress		Runs the regression cases, prints FAIL lines and exits 1 if any fails
+		z80test bench [n]	Runs each built-in benchmark n times (default 10), prints its time,
+							checksum and PASS/FAIL against the checksum the core should give
+		z80test com file	Runs a CP/M .COM program that only uses BDOS 0, 2 and 9 (ZEXDOC,
+							ZEXALL, ...), counts the groups it reports OK or ERROR, exits 1 on
+							an ERROR
+		z80test random first n [code]
+							Runs n programs of random bytes (biased towards common opcodes
+							with code) from random registers, seeded first to first + n - 1,
+							and prints the registers and a hash of RAM after each. Two builds
+							of the core must print the same. Needs -DREAD_LIMIT, which stops
+							a run after that many memory reads, e.g.:
+
+			g++ -O2 -Wall -Wextra -DREAD_LIMIT=400000 -I ... tools/z80test.cpp -o z80rnd
+			./z80rnd random 0 2000 code > a.txt		(then b.txt from another build)
+			tools/z80cmp.sh a.txt b.txt				(compares the runs neither stopped)
+
+							or from tools/, make OPTS="-DTHREADED" BASE="" random
+
+		z80test blocks first n
+							The same for single LDIR, LDDR, CPIR and CPDR instructions on
+							blocks at the ends of memory, overlapping or apart (-DREAD_LIMIT)
+
+	bench and com print instructions/s when built with -DPROFILE (counting them costs a little
+	speed) and T-states/s with -DDO_CYCLES.
+*/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"	// The firmware's state, which the core alone does not use
+#include "globals.h"
+#pragma GCC diagnostic pop
+
+/* Host side of what the core needs from the abstraction */
+static uint32 fakeMicros;
+
+uint32 micros(void) { return(fakeMicros += 7); }
+uint32 millis(void) { return(fakeMicros / 1000); }
+void delayMicroseconds(uint32 us) { fakeMicros += us; }
+int _kbhit(void) { return(0); }
+uint8_t _getch(void) { return(0x1a); }
+uint8 _getche(void) { return(0x1a); }
+void _putch(uint8 ch) { putchar(ch); }
+int _idlewait(uint32 ms) { fakeMicros += ms * 1000; return(0); }
+void _HardwareOut(const uint32, const uint32) {}
+uint32 _HardwareIn(const uint32) { return(0xff); }
+
+#ifdef READ_LIMIT
+/* Ends a random program once it has read READ_LIMIT bytes */
+extern int32 Status;
+static uint32 readCount;
+
+static inline uint8 _countedRead(uint32 a) {
+	if (++readCount == READ_LIMIT)
+		Status = 1;
+	return(RAM[a & 0xffff]);
+}
+#ifndef RAM_FAST
+#error READ_LIMIT needs RAM_FAST
+#endif
+#undef _RamRead
+#define _RamRead(a)			_countedRead(a)
+#endif
+
+#include "ram.h"
+#include "console.h"
+extern "C" void _Bios(void);
+extern "C" void _Bdos(void);
+#include "cpu.h"
+
+static bool randomMode;
+static uint32 randomTraps;
+
+/* OUT (0FFh),A (the BIOS trap) ends a run
+   Random programs go on after it, with registers and memory changed from what the trap
+   sees, so a core that doesn't hand its registers over (Z80spill/Z80fill) gives other results */
+extern "C" void _Bios(void) {
+	if (randomMode) {
+		HL = ((HL + BC) ^ 0x1234 ^ (PCX & 0xffff)) & 0xffff;
+		_RamWrite(DE & 0xffff, (IX ^ IY ^ SP) & 0xff);
+		SET_HIGH_REGISTER(AF, 0x42);
+		if (++randomTraps <= 50)
+			return;
+	}
+	Status = 1;
+}
+
+/* Console output, counting the lines an exerciser ends with OK or ERROR */
+static char conLine[128];
+static uint32 conLen, groupsOK, groupsFailed;
+
+static void _conout(uint8 ch) {
+	putchar(ch);
+	if (ch == '\n') {
+		conLine[conLen] = 0;
+		if (strstr(conLine, "ERROR"))
+			++groupsFailed;
+		else if (strstr(conLine, "OK"))
+			++groupsOK;
+		conLen = 0;
+	} else if (conLen < sizeof(conLine) - 1) {
+		conLine[conLen++] = ch;
+	}
+}
+
+/* IN A,(0FFh) (the BDOS trap) does console output */
+extern "C" void _Bdos(void) {
+	uint16 a;
+
+	if (randomMode) {
+		HL = ((DE * 3) ^ (PCX & 0xffff) ^ IR) & 0xffff;
+		SET_HIGH_REGISTER(AF, (BC ^ AF) & 0xff);
+		_RamWrite((HL + 1) & 0xffff, 0x76);	// HALT
+		if (LOW_REGISTER(BC) == 0 || ++randomTraps > 50)
+			Status = 1;
+		return;
+	}
+	switch (LOW_REGISTER(BC)) {
+		case 0:
+			Status = 1;
+			break;
+		case 2:
+			_conout(LOW_REGISTER(DE));
+			break;
+		case 9:
+			for (a = DE; _RamRead(a) != '$'; ++a)
+				_conout(_RamRead(a));
+			break;
+	}
+}
+
+// Fills RAM with bytes that differ from their neighbours, places code at 0x100 and runs it
+static void _run(const uint8* code, uint16 len) {
+	uint32 i;
+
+	for (i = 0; i < 0x10000; ++i)
+		_RamWrite(i, (i * 7 + 3) & 0xff);
+	for (i = 0; i < len; ++i)
+		_RamWrite(0x100 + i, code[i]);
+	AF = BC = DE = HL = IX = IY = 0;
+	SP = 0xf000;
+	PC = 0x100;
+	Status = 0;
+	Z80run();
+}
+
+/*	Regression cases
+
+	Each one runs a few instructions ending in OUT (0FFh),A, then compares HL, DE and BC
+	(masked), the Z flag when zf is not -1, and the bytes len bytes from dst against the
+	bytes that were at src before the run.
+*/
+typedef struct {
+	const char* name;
+	uint8 code[24];
+	uint16 hl, de, bc;
+	int8 zf;
+	uint16 dst, src, len;
+} regress_t;
+
+static const regress_t regressCases[] = {
+	// LDD at address 0 leaves HL and DE one below 0, LDIR must not use them as pointers
+	{ "LDIR after LDD at 0",
+		{ 0x21, 0x00, 0x00, 0x11, 0x00, 0x80, 0x01, 0x01, 0x00, 0xed, 0xa8,
+		  0x01, 0xa0, 0x00, 0xed, 0xb0, 0xd3, 0xff },
+		0x009f, 0x809f, 0x0000, -1, 0x8000, 0x0000, 0x009f },
+	{ "LDIR after LDD at 0 (wrapped byte)",
+		{ 0x21, 0x00, 0x00, 0x11, 0x00, 0x80, 0x01, 0x01, 0x00, 0xed, 0xa8,
+		  0x01, 0xa0, 0x00, 0xed, 0xb0, 0xd3, 0xff },
+		0x009f, 0x809f, 0x0000, -1, 0x7fff, 0xffff, 0x0001 },
+	{ "CPIR after CPD at 0",
+		{ 0x21, 0x00, 0x00, 0x01, 0x01, 0x00, 0xed, 0xa9, 0x3a, 0xff, 0xff,
+		  0x01, 0xa0, 0x00, 0xed, 0xb1, 0xd3, 0xff },
+		0x0000, 0x0000, 0x009f, 1, 0, 0, 0 },
+	// LDI/CPI at 0xffff leave HL one above it
+	{ "LDIR after LDI at ffff",
+		{ 0x21, 0xff, 0xff, 0x11, 0x00, 0x80, 0x01, 0x01, 0x00, 0xed, 0xa0,
+		  0x01, 0xa0, 0x00, 0xed, 0xb0, 0xd3, 0xff },
+		0x00a0, 0x80a1, 0x0000, -1, 0x8001, 0x0000, 0x00a0 },
+	{ "CPIR after CPI at ffff",
+		{ 0x21, 0xff, 0xff, 0x01, 0x01, 0x00, 0xed, 0xa1, 0x3a, 0x10, 0x00,
+		  0x01, 0xa0, 0x00, 0xed, 0xb1, 0xd3, 0xff },
+		0x0011, 0x0000, 0x008f, 1, 0, 0, 0 },
+	{ "LDDR after LDD at 0",
+		{ 0x21, 0x00, 0x00, 0x11, 0x00, 0x80, 0x01, 0x01, 0x00, 0xed, 0xa8,
+		  0x01, 0x10, 0x00, 0xed, 0xb8, 0xd3, 0xff },
+		0xffef, 0x7fef, 0x0000, -1, 0x7ff0, 0xfff0, 0x0010 },
+	{ "CPDR after CPD at 0",
+		{ 0x21, 0x00, 0x00, 0x01, 0x01, 0x00, 0xed, 0xa9, 0x3a, 0xf0, 0xff,
+		  0x01, 0xa0, 0x00, 0xed, 0xb9, 0xd3, 0xff },
+		0xffef, 0x0000, 0x0090, 1, 0, 0, 0 },
+};
+
+static int _regress(void) {
+	static uint8 before[0x10000];
+	const regress_t* t;
+	int failed = 0;
+	uint32 i;
+
+	for (t = regressCases; t < regressCases + sizeof(regressCases) / sizeof(regressCases[0]); ++t) {
+		_run(t->code, sizeof(t->code));
+		for (i = 0; i < 0x10000; ++i)
+			before[i] = (i * 7 + 3) & 0xff;
+		if ((HL & 0xffff) != t->hl || (DE & 0xffff) != t->de || (BC & 0xffff) != t->bc ||
+			(t->zf != -1 && ((AF >> 6) & 1) != t->zf)) {
+			printf("FAIL %s: HL=%04x DE=%04x BC=%04x F=%02x\n", t->name, HL & 0xffff, DE & 0xffff, BC & 0xffff, AF & 0xff);
+			++failed;
+			continue;
+		}
+		for (i = 0; i < t->len; ++i)
+			if (_RamRead((t->dst + i) & 0xffff) != before[(t->src + i) & 0xffff]) {
+				printf("FAIL %s: byte %04x is %02x\n", t->name, (t->dst + i) & 0xffff, _RamRead((t->dst + i) & 0xffff));
+				++failed;
+				break;
+			}
+	}
+	printf("%d regression cases, %d failed\n", (int)(sizeof(regressCases) / sizeof(regressCases[0])), failed);
+	return(failed ? 1 : 0);
+}
+
+/* Runs code at 0x100 like the CCP would: RET and JP 0 end it, CALL 5 reaches _Bdos() */
+static void _runcom(const uint8* code, uint32 len) {
+	static const uint8 page0[] = { 0xd3, 0xff, 0x00, 0x00, 0x00, 0xc3, 0x00, 0xfe };	// OUT (0FFh),A, JP 0FE00h
+	uint32 i;
+
+	for (i = 0; i < 0x10000; ++i)
+		_RamWrite(i, (i * 7 + 3) & 0xff);
+	for (i = 0; i < len; ++i)
+		_RamWrite(0x100 + i, code[i]);
+	for (i = 0; i < sizeof(page0); ++i)
+		_RamWrite(i, page0[i]);
+	_RamWrite(0xfe00, 0xdb);	// IN A,(0FFh)
+	_RamWrite(0xfe01, 0xff);
+	_RamWrite(0xfe02, 0xc9);	// RET
+	_RamWrite16(0xfdfe, 0x0000);
+	AF = BC = DE = HL = IX = IY = 0;
+	SP = 0xfdfe;
+	PC = 0x100;
+	Status = 0;
+	Z80run();
+}
+
+static double _seconds(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+	return(t.tv_sec + t.tv_nsec / 1e9);
+}
+
+// Prints the speed of a run that took sec seconds and started at the given counts
+static void _speed(double sec, uint64 instrs, uint64 cycles) {
+	(void)instrs;
+	(void)cycles;
+	printf(" %.3f s", sec);
+#ifdef PROFILE
+	printf(", %.2f M instructions/s", (Instrs - instrs) / sec / 1e6);
+#endif
+#ifdef DO_CYCLES
+	printf(", %.2f M T-states/s", (Cycles - cycles) / sec / 1e6);
+#endif
+}
+
+static uint64 _instrs(void) {
+#ifdef PROFILE
+	return(Instrs);
+#else
+	return(0);
+#endif
+}
+
+static uint64 _cycles(void) {
+#ifdef DO_CYCLES
+	return(Cycles);
+#else
+	return(0);
+#endif
+}
+
+/*	Benchmarks
+
+	CPU-bound loops ending in OUT (0FFh),A. The checksum covers RAM and the main registers
+	after the last run, so it also tells if a change to the core altered the results.
+*/
+typedef struct {
+	const char* name;
+	uint8 code[112];
+	uint32 sum;
+} bench_t;
+
+static const bench_t benchCases[] = {
+	// 100 times: fills 7936 flags with LDIR, clears the multiples of each set one (sieve),
+	// then 256 shift/add steps through (IY+d) with a CALL to a PUSH/ADC/NEG/POP subroutine
+	{ "sieve/multiply",
+		{ 0x3e, 0x64, 0x32, 0x00, 0x10, 0x21, 0x00, 0x20, 0x11, 0x01, 0x20, 0x01,
+		  0xff, 0x1e, 0x36, 0x01, 0xed, 0xb0, 0x21, 0x00, 0x20, 0x01, 0x00, 0x00,
+		  0xdd, 0x21, 0x00, 0x00, 0x7e, 0xb7, 0x28, 0x17, 0xe5, 0x60, 0x69, 0x29,
+		  0x23, 0x23, 0x23, 0xeb, 0xe1, 0xe5, 0x19, 0x7c, 0xfe, 0x3f, 0x30, 0x04,
+		  0x36, 0x00, 0x18, 0xf6, 0xe1, 0xdd, 0x23, 0x23, 0x03, 0x78, 0xfe, 0x1f,
+		  0x38, 0xde, 0xfd, 0x21, 0x00, 0x30, 0x06, 0x00, 0xfd, 0x7e, 0x01, 0xcb,
+		  0x27, 0xcb, 0x11, 0xfd, 0x77, 0x01, 0xfd, 0x34, 0x02, 0xcd, 0x62, 0x01,
+		  0x10, 0xee, 0x3a, 0x00, 0x10, 0x3d, 0x32, 0x00, 0x10, 0xc2, 0x05, 0x01,
+		  0xd3, 0xff, 0xf5, 0x87, 0x8f, 0xce, 0x03, 0xed, 0x44, 0xf1, 0xc9 },
+		0x626e03ad },
+	// 256 times: LDIR 16K up, CPIR for 0A5h, LDDR the 16K back
+	{ "block moves",
+		{ 0x3e, 0x00, 0x32, 0x00, 0x10, 0x21, 0x00, 0x20, 0x11, 0x00, 0x60, 0x01,
+		  0x00, 0x40, 0xed, 0xb0, 0x21, 0x00, 0x20, 0x01, 0x00, 0x40, 0x3e, 0xa5,
+		  0xed, 0xb1, 0x21, 0xff, 0x9f, 0x11, 0xff, 0x5f, 0x01, 0x00, 0x40, 0xed,
+		  0xb8, 0x3a, 0x00, 0x10, 0x3d, 0x32, 0x00, 0x10, 0xc2, 0x05, 0x01, 0xd3,
+		  0xff },
+		0x89578787 },
+	// 16 times: 256 passes of 256 steps alternating (IX+d) and (IY+d) loads, adds and stores
+	{ "index registers",
+		{ 0x3e, 0x10, 0x32, 0x01, 0x10, 0x3e, 0x00, 0x32, 0x00, 0x10, 0xdd, 0x21,
+		  0x00, 0x20, 0xfd, 0x21, 0x00, 0x30, 0x06, 0x00, 0xdd, 0x7e, 0x00, 0xfd,
+		  0x86, 0x01, 0xdd, 0x77, 0x02, 0xfd, 0x34, 0x00, 0xdd, 0x23, 0xfd, 0x23,
+		  0x10, 0xee, 0x3a, 0x00, 0x10, 0x3d, 0x32, 0x00, 0x10, 0xc2, 0x0a, 0x01,
+		  0x3a, 0x01, 0x10, 0x3d, 0x32, 0x01, 0x10, 0xc2, 0x05, 0x01, 0xd3, 0xff },
+		0x166ad1fc },
+};
+
+static uint32 _checksum(void) {
+	uint32 h = 2166136261u;
+	uint32 i;
+
+	for (i = 0; i < 0x10000; ++i)
+		h = (h ^ _RamRead(i)) * 16777619u;
+	h = (h ^ (AF & 0xffff)) * 16777619u;
+	h = (h ^ (BC & 0xffff)) * 16777619u;
+	h = (h ^ (DE & 0xffff)) * 16777619u;
+	h = (h ^ (HL & 0xffff)) * 16777619u;
+	h = (h ^ (IX & 0xffff)) * 16777619u;
+	h = (h ^ (IY & 0xffff)) * 16777619u;
+	return(h);
+}
+
+static int _bench(int n) {
+	const bench_t* b;
+	int failed = 0;
+	uint64 instrs, cycles;
+	double start;
+	uint32 sum;
+	int i;
+
+	for (b = benchCases; b < benchCases + sizeof(benchCases) / sizeof(benchCases[0]); ++b) {
+		instrs = _instrs();
+		cycles = _cycles();
+		start = _seconds();
+		for (i = 0; i < n; ++i)
+			_runcom(b->code, sizeof(b->code));
+		printf("%-16s", b->name);
+		_speed(_seconds() - start, instrs, cycles);
+		sum = _checksum();
+		printf(", checksum %08x %s\n", sum, sum == b->sum ? "PASS" : "FAIL");
+		if (sum != b->sum)
+			++failed;
+	}
+	return(failed ? 1 : 0);
+}
+
+static int _com(const char* name) {
+	static uint8 code[0xfd00];
+	uint64 instrs, cycles;
+	double start;
+	uint32 len;
+	FILE* f;
+
+	if (!(f = fopen(name, "rb"))) {
+		perror(name);
+		return(2);
+	}
+	len = fread(code, 1, sizeof(code), f);
+	fclose(f);
+	instrs = _instrs();
+	cycles = _cycles();
+	start = _seconds();
+	_runcom(code, len);
+	printf("\n%s:", name);
+	_speed(_seconds() - start, instrs, cycles);
+	printf(", %u groups OK, %u ERROR\n", groupsOK, groupsFailed);
+	return(groupsFailed ? 1 : 0);
+}
+
+#ifdef READ_LIMIT
+/* Random programs */
+static uint64 randomState;
+
+// A run stuck in a loop that reads nothing from memory (block cache) ends after a second
+static void _timeout(int) {
+	Status = 1;
+	readCount = READ_LIMIT;
+}
+
+static uint32 _random(void) {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return((uint32)randomState);
+}
+
+// Runs from the registers set up and prints the state at the end
+static void _randomRun(int seed) {
+	PCX = 0;
+	Status = 0;
+	randomTraps = 0;
+	readCount = 0;
+	alarm(1);
+	Z80run();
+	alarm(0);
+	if (readCount >= READ_LIMIT) {
+		printf("%d LIMIT\n", seed);	// Stopped at a point that depends on the build
+		return;
+	}
+	printf("%d AF=%04x BC=%04x DE=%04x HL=%04x IX=%04x IY=%04x SP=%04x PC=%04x IR=%04x "
+		"AF1=%04x BC1=%04x DE1=%04x HL1=%04x IFF=%d SUM=%08x\n", seed,
+		AF & 0xffff, BC & 0xffff, DE & 0xffff, HL & 0xffff, IX & 0xffff, IY & 0xffff, SP & 0xffff,
+		PC & 0xffff, IR & 0xffff, AF1 & 0xffff, BC1 & 0xffff, DE1 & 0xffff, HL1 & 0xffff, IFF, _checksum());
+}
+
+static int _randomRuns(int first, int n, bool code) {
+	static const uint8 common[] = {
+		0x7e, 0x23, 0x05, 0x20, 0xc2, 0xb7, 0x28, 0xca, 0xeb, 0x19, 0xc5, 0xd5, 0xd1, 0xc1, 0x78, 0xb1,
+		0xdd, 0xfd, 0xed, 0xb0, 0xb8, 0x10, 0x36, 0x77, 0x2b, 0xcb, 0x86, 0x96, 0xbe, 0xfe, 0xc6, 0xd6,
+		0xed, 0x5f, 0x4f, 0x18, 0xfe, 0xf5, 0xf1, 0x1f, 0x17, 0x27, 0x3f, 0x37 };
+	uint32 i, r;
+	int seed;
+
+	randomMode = TRUE;
+	signal(SIGALRM, _timeout);
+	for (seed = first; seed < first + n; ++seed) {
+		randomState = 0x9e3779b97f4a7c15ull * (seed + 1);
+		for (i = 0; i < 0x10000; ++i) {
+			r = _random();
+			RAM[i] = code && (r & 3) ? common[(r >> 8) % sizeof(common)] : r >> 16;
+		}
+		AF = _random() & 0xffff; BC = _random() & 0xffff; DE = _random() & 0xffff; HL = _random() & 0xffff;
+		IX = _random() & 0xffff; IY = _random() & 0xffff; SP = _random() & 0xffff; PC = _random() & 0xffff;
+		AF1 = _random() & 0xffff; BC1 = _random() & 0xffff; DE1 = _random() & 0xffff; HL1 = _random() & 0xffff;
+		IR = _random() & 0xffff;
+		IFF = _random() & 3;
+		_randomRun(seed);
+	}
+	return(0);
+}
+
+// An address that is often close to one end of memory
+static uint32 _randomEdge(void) {
+	uint32 r = _random();
+
+	switch (r & 3) {
+		case 0:
+			return((r >> 8) & 0x1f);
+		case 1:
+			return(0xffe0 + ((r >> 8) & 0x1f));
+		default:
+			return((r >> 8) & 0xffff);
+	}
+}
+
+/*	Random block instructions
+
+	Each run sets HL, DE and BC near the ends of memory, with the blocks overlapping or apart
+	and BC often small or 0, then runs LDIR, LDDR, CPIR or CPDR, after an LDI, LDD, CPI or
+	CPD half the time so HL and DE can start just outside 0..ffff.
+*/
+static int _blockRuns(int first, int n) {
+	static const uint8 single[] = { 0xa0, 0xa8, 0xa1, 0xa9 };	// LDI, LDD, CPI, CPD
+	static const uint8 repeat[] = { 0xb0, 0xb8, 0xb1, 0xb9 };	// LDIR, LDDR, CPIR, CPDR
+	uint32 i, r, pc;
+	int seed;
+
+	randomMode = TRUE;
+	signal(SIGALRM, _timeout);
+	for (seed = first; seed < first + n; ++seed) {
+		randomState = 0x9e3779b97f4a7c15ull * (seed + 1);
+		for (i = 0; i < 0x10000; ++i)
+			RAM[i] = _random() >> 16;
+		r = _random();
+		HL = _randomEdge();
+		switch ((r >> 4) & 3) {
+			case 0:
+				DE = (HL + ((r >> 8) & 7) - 3) & 0xffff;	// Overlapping
+				break;
+			case 1:
+				DE = _randomEdge();
+				break;
+			default:
+				DE = _random() & 0xffff;
+		}
+		switch ((r >> 12) & 3) {
+			case 0:
+				BC = 0;
+				break;
+			case 1:
+				BC = 1 + ((r >> 16) & 0x1f);
+				break;
+			case 2:
+				BC = _random() & 0xff;
+				break;
+			default:
+				BC = _random() & 0xffff;
+		}
+		AF = _random() & 0xffff;
+		IX = IY = 0;
+		AF1 = BC1 = DE1 = HL1 = 0;
+		SP = 0x8000;
+		IR = 0;
+		IFF = 0;
+		pc = PC = _random() & 0xfff0;
+		if (r & 0x40) {
+			RAM[pc++] = 0xed;
+			RAM[pc++] = single[(r >> 20) & 3];
+		}
+		RAM[pc++] = 0xed;
+		RAM[pc++] = repeat[(r >> 24) & 3];
+		RAM[pc++] = 0xd3;	// OUT (0FFh),A
+		RAM[pc++] = 0xff;
+		_randomRun(seed);
+	}
+	return(0);
+}
+#endif
+
+int main(int argc, char** argv) {
+	if (argc > 1 && !strcmp(argv[1], "regress"))
+		return(_regress());
+	if (argc > 1 && !strcmp(argv[1], "bench"))
+		return(_bench(argc > 2 ? atoi(argv[2]) : 10));
+	if (argc > 2 && !strcmp(argv[1], "com"))
+		return(_com(argv[2]));
+#ifdef READ_LIMIT
+	if (argc > 3 && !strcmp(argv[1], "random"))
+		return(_randomRuns(atoi(argv[2]), atoi(argv[3]), argc > 4 && !strcmp(argv[4], "code")));
+	if (argc > 3 && !strcmp(argv[1], "blocks"))
+		return(_blockRuns(atoi(argv[2]), atoi(argv[3])));
+#endif
+	fprintf(stderr, "usage: z80test regress | bench [n] | com file | random first n [code] | blocks first n\n");
+	return(2);
+}